@@ -4,6 +4,14 @@
 
 #include "struc.h"
 
+#if defined(__linux__) && !defined(__CINT__)
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef MFD_CLOEXEC                  // memfd_create() is available
+#define __MIRROR_MMAP__
+#endif
+#endif
+
 // ============================================================
 
 // a simple FIFO buffer
@@ -192,6 +200,297 @@ template <class Type>
 	   else if(Offset>=(int)Size) Offset-=Size;
 	   return Data+Offset; }
 
+   // save (Load=0) or load (Load=1) the pointer and the Rows rows written last (before it),
+   // on load the other rows are cleared; the buffer must be preset the same
+   int StateIO(FILE *File, int Load, size_t Rows)
+     { if(Rows>Len) return -1;
+       if(Load) Clear();
+       if(StateArray(File,Load,&Ptr,1)<0) return -1;
+       if(Ptr>=Len) { Ptr=0; return -1; }
+       size_t Start=Ptr; DecrPtr(Start,Rows);
+       size_t First = (Start+Rows)<=Len ? Rows : Len-Start;
+       if(StateArray(File,Load,Data+Start*Width,First*Width)<0) return -1;
+       return StateArray(File,Load,Data,(Rows-First)*Width); }
+
+} ;
+
+// ============================================================
+
+// A circular buffer (tap line) of power-of-2 length Len where any window
+// of up to Len elements is contiguous in memory: Data[Idx+Len] is Data[Idx].
+// Where possible the same physical pages are mapped twice (Mapped=1),
+// otherwise twice the storage is allocated and Mirror() copies what was
+// written into the other half. The mapping needs Len*sizeof(Type)
+// to be a multiple of the page size, shorter buffers use the copy.
+template <class Type>
+ class MirrorBuffer
+{ public:
+
+   size_t Len;    // buffer length (a power of 2)
+   size_t Mask;   // wrap mask = Len-1
+   size_t Ptr;    // current pointer, always within [0..Len)
+   Type  *Data;   // storage: 2*Len elements can be addressed
+   int Mapped;    // 1 => the pages are mapped twice and Mirror() has nothing to do
+
+  public:
+   MirrorBuffer()
+     { Init(); }
+
+   ~MirrorBuffer()
+     { Free(); }
+
+   void Init(void)
+     { Data=0; Len=0; Mapped=0; }
+
+   void Free(void)
+     {
+#ifdef __MIRROR_MMAP__
+       if(Mapped) { munmap(Data,2*Len*sizeof(Type)); Data=0; }
+#endif
+       free(Data); Data=0; Mapped=0; }
+
+   // preset for given length, which must be a power of 2
+   int Preset(size_t NewLen)
+     { Free(); Len=NewLen; Mask=Len-1;
+       if(Map()<0)
+       { if(ReallocArray(&Data,2*Len)<0) return -1; }
+       Reset(); return 0; }
+
+   // clear the data and set the pointer to the beginning
+   void Reset(void)
+     { ClearArray(Data, Mapped ? Len:2*Len);
+       Ptr=0; }
+
+   // advance the pointer
+   void operator += (size_t Step)
+     { Ptr+=Step; Ptr&=Mask; }
+
+   // the window starting Offset elements after the current pointer
+   Type *Window(size_t Offset=0)
+     { return Data+((Ptr+Offset)&Mask); }
+
+   // after writing Count elements into Window(Offset) copy them into the other half
+   void Mirror(size_t Offset, size_t Count)
+     { if(Mapped) return;
+       size_t Start=(Ptr+Offset)&Mask;
+       size_t Stop=Start+Count;
+       if(Stop<=Len)
+         CopyArray(Data+Start+Len,Data+Start,Count);
+       else
+       { CopyArray(Data+Start+Len,Data+Start,Len-Start);
+         CopyArray(Data,Data+Len,Stop-Len); }
+     }
+
+   // write Count new elements and advance the pointer
+   template <class InpType>
+    void Write(InpType *Input, size_t Count)
+     { Type *Dst=Window(); size_t Idx;
+       for(Idx=0; Idx<Count; Idx++)
+         Dst[Idx]=Input[Idx];
+       Mirror(0,Count); (*this)+=Count; }
+
+   // write Count zeros and advance the pointer
+   void WriteZeros(size_t Count)
+     { ClearArray(Window(),Count);
+       Mirror(0,Count); (*this)+=Count; }
+
+   // read Count elements and clear them behind, advance the pointer
+   template <class OutType>
+    void ReadClear(OutType *Output, size_t Count)
+     { Type *Src=Window(); size_t Idx;
+       for(Idx=0; Idx<Count; Idx++)
+         Output[Idx]=Src[Idx];
+       ClearArray(Src,Count);
+       Mirror(0,Count); (*this)+=Count; }
+
+   // save (Load=0) or load (Load=1) the data and the pointer, the buffer must be preset the same
+   int StateIO(FILE *File, int Load)
+     { if(StateArray(File,Load,&Ptr,1)<0) return -1;
+       if(StateArray(File,Load,Data,Len)<0) return -1;
+       if(Load)
+       { Ptr&=Mask;
+         if(!Mapped) CopyArray(Data+Len,Data,Len); }
+       return 0; }
+
+   // the same for only the Count elements from the pointer on (the rest is cleared on load)
+   int StateIO(FILE *File, int Load, size_t Count)
+     { if(Count>Len) return -1;
+       if(Load) Reset();
+       if(StateArray(File,Load,&Ptr,1)<0) return -1;
+       Ptr&=Mask;
+       if(StateArray(File,Load,Window(),Count)<0) return -1;
+       if(Load) Mirror(0,Count);
+       return 0; }
+
+  private:
+
+   // map the same (zeroed) memory twice, one copy right after the other
+   int Map(void)
+     {
+#ifdef __MIRROR_MMAP__
+       size_t Bytes=Len*sizeof(Type);
+       long Page=sysconf(_SC_PAGESIZE);
+       if((Page<=0)||(Bytes==0)||(Bytes%Page)) return -1;
+       int File=memfd_create("MirrorBuffer",MFD_CLOEXEC);
+       if(File<0) return -1;
+       char *Base=0;
+       if(ftruncate(File,Bytes)<0) goto Error;
+       Base=(char *)mmap(0,2*Bytes,PROT_NONE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+       if(Base==MAP_FAILED) { Base=0; goto Error; }
+       if(mmap(Base,Bytes,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_FIXED,File,0)==MAP_FAILED) goto Error;
+       if(mmap(Base+Bytes,Bytes,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_FIXED,File,0)==MAP_FAILED) goto Error;
+       close(File);
+       Data=(Type *)Base; Mapped=1; return 0;
+
+       Error: if(Base) munmap(Base,2*Bytes);
+       close(File);
+#endif
+       return -1; }
+
+} ;
+
+// ============================================================
+
+// A FIFO between one producer and one consumer thread, without locks.
+// The write and read counters run freely (they only wrap at the size_t limit)
+// and each is aligned to its own cache line, together with the private copy
+// of the other side's counter, which is reloaded only when the view
+// from that copy is not enough.
+// The storage is a MirrorBuffer, thus all the free space (or all the data
+// ready) is one contiguous span:
+//   the producer fills WriteSpan() and calls Written(),
+//   the consumer takes ReadSpan() and calls Consumed().
+template <class Type>
+ class LockFreeFIFO
+{ public:
+
+   size_t Len;               // capacity, rounded up to a power of 2
+
+  private:
+
+   static const size_t CacheLine=64;
+
+   MirrorBuffer<Type> Buffer;
+
+   alignas(CacheLine) size_t WritePtr;   // the producer side
+   size_t ReadCache;                     // its view of ReadPtr
+
+   alignas(CacheLine) size_t ReadPtr;    // the consumer side
+   size_t WriteCache;                    // its view of WritePtr
+
+  public:
+
+   LockFreeFIFO()
+     { Init(); }
+
+   void Init(void)
+     { Len=0; }
+
+   void Free(void)
+     { Buffer.Free(); Len=0; }
+
+   int Preset(size_t NewLen)
+     { Len=NewLen; return Preset(); }
+
+   int Preset(void)
+     { size_t Size;
+       for(Size=1; Size<Len; Size<<=1) { }       // round up to a power of two
+       Len=Size;
+       if(Buffer.Preset(Len)<0) return -1;
+       Reset(); return 0; }
+
+   // empty the FIFO: only when neither side is using it
+   void Reset(void)
+     { WritePtr=ReadCache=0;
+       ReadPtr=WriteCache=0; }
+
+   // the consumer may drop all the data ready
+   void Clear(void)
+     { Consumed(ReadReady()); }
+
+   // how many elements the producer can write
+   size_t WriteReady(void)
+     { return Len-(WritePtr-__atomic_load_n(&ReadPtr,__ATOMIC_ACQUIRE)); }
+
+   // how many elements the consumer can read
+   size_t ReadReady(void)
+     { return __atomic_load_n(&WritePtr,__ATOMIC_ACQUIRE)-ReadPtr; }
+
+   int Full(void)
+     { return WriteReady()==0; }
+
+   int Empty(void)
+     { return ReadReady()==0; }
+
+   // producer: the free space, as seen when at least Need elements are free
+   size_t WriteSpan(Type *&Ptr, size_t Need=1)
+     { size_t Free=Len-(WritePtr-ReadCache);
+       if(Free<Need)
+       { ReadCache=__atomic_load_n(&ReadPtr,__ATOMIC_ACQUIRE);
+         Free=Len-(WritePtr-ReadCache); }
+       Ptr=Buffer.Data+(WritePtr&Buffer.Mask);
+       return Free; }
+
+   // producer: hand over Count elements written into the span
+   void Written(size_t Count)
+     { Buffer.Mirror(WritePtr&Buffer.Mask,Count);
+       __atomic_store_n(&WritePtr,WritePtr+Count,__ATOMIC_RELEASE); }
+
+   // consumer: the data ready, as seen when at least Need elements are there
+   size_t ReadSpan(Type *&Ptr, size_t Need=1)
+     { size_t Ready=WriteCache-ReadPtr;
+       if(Ready<Need)
+       { WriteCache=__atomic_load_n(&WritePtr,__ATOMIC_ACQUIRE);
+         Ready=WriteCache-ReadPtr; }
+       Ptr=Buffer.Data+(ReadPtr&Buffer.Mask);
+       return Ready; }
+
+   // consumer: give Count elements of the span back
+   void Consumed(size_t Count)
+     { __atomic_store_n(&ReadPtr,ReadPtr+Count,__ATOMIC_RELEASE); }
+
+   // write a new element
+   int Write(Type &NewData)
+     { Type *Ptr;
+       if(WriteSpan(Ptr)==0) return 0;
+       (*Ptr)=NewData; Written(1); return 1; }
+
+   // read the oldest element
+   int Read(Type &OldData)
+     { Type *Ptr;
+       if(ReadSpan(Ptr)==0) return 0;
+       OldData=(*Ptr); Consumed(1); return 1; }
+
+   // write up to Count elements, return how many were written
+   size_t Write(Type *Data, size_t Count)
+     { Type *Ptr;
+       size_t Free=WriteSpan(Ptr,Count);
+       if(Count>Free) Count=Free;
+       CopyArray(Ptr,Data,Count); Written(Count);
+       return Count; }
+
+   // read up to Count elements, return how many were read
+   size_t Read(Type *Data, size_t Count)
+     { Type *Ptr;
+       size_t Ready=ReadSpan(Ptr,Count);
+       if(Count>Ready) Count=Ready;
+       CopyArray(Data,Ptr,Count); Consumed(Count);
+       return Count; }
+
+   // save (Load=0) or load (Load=1) the data ready: only when neither side is using the FIFO
+   int StateIO(FILE *File, int Load)
+     { Type *Ptr;
+       size_t Ready = Load ? 0:ReadReady();
+       if(StateArray(File,Load,&Ready,1)<0) return -1;
+       if(!Load)
+       { ReadSpan(Ptr,Ready);
+         return StateArray(File,0,Ptr,Ready); }
+       Reset();
+       if(Ready>Len) return -1;
+       WriteSpan(Ptr,Ready);
+       if(StateArray(File,1,Ptr,Ready)<0) return -1;
+       Written(Ready); return 0; }
+
 } ;
 
 // ============================================================
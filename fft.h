@@ -270,6 +270,38 @@ template <class Type>
 
 // ---------------------------------------------------------------------------
 
+// Kernels for the windowing of tap lines which are contiguous in memory
+// (see MirrorBuffer in buffer.h), thus there is no per-sample wrapping
+// and the compiler can vectorize them.
+// Part selects the real (0) or the imaginary (1) part of the complex buffer.
+
+// Buff[Time].(Re/Im) = Tap[Time]*Shape[Time]
+template <int Part, class Type, class TapType, class ShapeType>
+ void WindowTap(Cmpx<Type> *Buff, TapType *Tap, size_t Len, ShapeType *Shape)
+{ size_t Time;
+  for(Time=0; Time<Len; Time++)
+    (&Buff[Time].Re)[Part]=Tap[Time]*Shape[Time];
+}
+
+// Tap[Time] += Buff[Time].(Re/Im)*Shape[Time]
+template <int Part, class Type, class TapType, class ShapeType>
+ void OverlapAddTap(TapType *Tap, size_t Len, Cmpx<Type> *Buff, ShapeType *Shape)
+{ size_t Time;
+  for(Time=0; Time<Len; Time++)
+    Tap[Time]+=(&Buff[Time].Re)[Part]*Shape[Time];
+}
+
+// energies of a spectra: computed and returned in Type (Cmpx::Energy() returns a double)
+template <class Type>
+ void SpectraEnergy(Type *Energy, Cmpx<Type> *Spectra, size_t Len)
+{ size_t Idx;
+  for(Idx=0; Idx<Len; Idx++)
+  { Type Re=Spectra[Idx].Re, Im=Spectra[Idx].Im;
+    Energy[Idx]=Re*Re+Im*Im; }
+}
+
+// ---------------------------------------------------------------------------
+
 #if 0 // unused code, under developement
 
 // sliding window for FFT spectral analysis
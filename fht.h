@@ -37,5 +37,27 @@ template <class Type>
   }
 }
 
+// Forward FHT of several sequences interleaved in memory:
+// Data[Idx*Lanes+Lane] is element Idx of sequence Lane,
+// only lanes from Start to Stop-1 are transformed.
+// The inner loop goes along the lanes thus it can be vectorized.
+
+template <class Type>
+ void FHT(Type *Data, size_t Len, size_t Lanes, size_t Start, size_t Stop)
+{ size_t Step, Ptr, Ptr2, Lane; Type Bit1, Bit2;
+  for(Step=1; Step<Len; Step*=2)
+  { for(Ptr=0; Ptr<Len; Ptr+=2*Step)
+    { for(Ptr2=Ptr; (Ptr2-Ptr)<Step; Ptr2+=1)
+      { Type *Data1=Data+Ptr2*Lanes;
+        Type *Data2=Data+(Ptr2+Step)*Lanes;
+        for(Lane=Start; Lane<Stop; Lane++)
+        { Bit1=Data1[Lane]; Bit2=Data2[Lane];
+          Data1[Lane]=Bit2+Bit1;
+          Data2[Lane]=Bit2-Bit1; }
+      }
+    }
+  }
+}
+
 #endif // of __FHT_H__
 
@@ -2,6 +2,8 @@
 #ifndef __LOWPASS3_H__
 #define __LOWPASS3_H__
 
+#include "struc.h"
+
 // ==========================================================================
 
 // IIR low pass filter for integration (averaging) purposes
@@ -31,6 +33,120 @@ template <class Type>
 } ;
 
 
+// ==========================================================================
+
+// A bank of LowPass3_Filter's arranged in Len rows of Width filters,
+// the rows are addressed in a circular way like in the CircularBuffer.
+// The filter state is kept in separate arrays (Out1, Out2, Output),
+// so a row (or a part of it) is processed with vector operations.
+
+template <class Type>
+ class LowPass3Bank
+{ public:
+
+   size_t Width;  // number of filters in a row
+   size_t Len;    // number of rows
+
+  public:
+
+   size_t Size;   // total number of filters
+   Type *Out1;    // filter states [Len][Width], all three in one allocation
+   Type *Out2;
+   Type *Output;  // filter outputs [Len][Width]
+
+  public:
+
+   LowPass3Bank()
+     { Init(); }
+
+   ~LowPass3Bank()
+     { free(Out1); }
+
+   void Init(void)
+     { Out1=0; Out2=0; Output=0; Size=0; Width=1; }
+
+   void Free(void)
+     { free(Out1); Out1=0; Out2=0; Output=0; Size=0; }
+
+   int Preset(void)
+     { Size=Width*Len;
+       if(ReallocArray(&Out1,3*Size)<0) return -1;
+       Out2=Out1+Size; Output=Out2+Size;
+       return 0; }
+
+   // set all filters to zero
+   void Clear(void)
+     { ClearArray(Out1,3*Size); }
+
+   // set the filters [Start..Stop) of a row to zero
+   void ClearRow(size_t Row, size_t Start, size_t Stop)
+     { if(Stop<=Start) return;
+       size_t Ofs=Row*Width+Start;
+       ClearArray(Out1+Ofs,Stop-Start);
+       ClearArray(Out2+Ofs,Stop-Start);
+       ClearArray(Output+Ofs,Stop-Start); }
+
+   // save (Load=0) or load (Load=1) all the filters, the bank must be preset the same
+   int StateIO(FILE *File, int Load)
+     { return StateArray(File,Load,Out1,3*Size); }
+
+   // outputs of the given row
+   Type *operator [] (size_t Row)
+     { return Output+(Row*Width); }
+
+   // process the filters [Start..Stop) of a row with the inputs Input[Start..Stop)
+   template <class InpType, class WeightType>
+    void ProcessRow(size_t Row, InpType *Input, WeightType Weight,
+                    size_t Start, size_t Stop, WeightType Feedback=0.1)
+     { Type *Row1=Out1+(Row*Width);
+       Type *Row2=Out2+(Row*Width);
+       Type *Row3=Output+(Row*Width);
+       Weight *= 2.0;
+       size_t Idx;
+       for(Idx=Start; Idx<Stop; Idx++)
+       { Type DiffI1 = Input[Idx]; DiffI1 -= Row1[Idx];
+         Type Diff12 = Row1[Idx];  Diff12 -= Row2[Idx];
+         Type Diff23 = Row2[Idx];  Diff23 -= Row3[Idx];
+         DiffI1 *= Weight;   Row1[Idx] += DiffI1;
+         Diff12 *= Weight;   Row2[Idx] += Diff12;
+         Diff23 *= Weight;   Row3[Idx] += Diff23;
+         Diff23 *= Feedback; Row2[Idx] += Diff23; }
+     }
+
+   // as above, then find the first highest output in [Start..Stop) which is above Peak:
+   // returns its index and updates Peak or returns Stop when no output is above Peak
+   template <class InpType, class WeightType>
+    size_t ProcessRowPeak(size_t Row, InpType *Input, WeightType Weight,
+                          size_t Start, size_t Stop, Type &Peak, WeightType Feedback=0.1)
+     { ProcessRow(Row, Input, Weight, Start, Stop, Feedback);
+       Type *Row3=Output+(Row*Width);
+       size_t PeakIdx=Stop;
+       size_t Idx;
+       for(Idx=Start; Idx<Stop; Idx++)
+       { if(Row3[Idx]>Peak) { Peak=Row3[Idx]; PeakIdx=Idx; } }
+       return PeakIdx; }
+
+   // increment the row pointer (with wrapping around)
+   void IncrPtr(size_t &Ptr, size_t Step=1)
+     { Ptr+=Step; if(Ptr>=Len) Ptr-=Len; }
+
+   // decrement the row pointer (with wrapping around)
+   void DecrPtr(size_t &Ptr, size_t Step=1)
+     { if(Ptr>=Step) Ptr-=Step;
+	            else Ptr+=(Len-Step); }
+
+   template <class PhaseType>
+    void WrapPhase(PhaseType &Phase)
+     { if(Phase<0) Phase+=Len;
+	   else if(Phase>=Len) Phase-=Len; }
+
+   template <class PhaseType>
+    void WrapDiffPhase(PhaseType &Phase)
+     { if(Phase<(-(PhaseType)Len/2)) Phase+=Len;
+	   else if(Phase>=((PhaseType)Len/2)) Phase-=Len; }
+
+} ;
+
 // ==========================================================================
 
 #endif // of __LOWPASS3_H__
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <math.h>
+#include <time.h>
 
 #include "struc.h"
 #include "fht.h"
@@ -18,6 +19,7 @@
 #include "lowpass3.h"
 #include "buffer.h"
 #include "rateconv.h"
+#include "threads.h"
 
 #include "noise.h"
 
@@ -120,6 +122,19 @@ template <class FloatType=float>
   size_t RxSyncMargin;                       // [MFSK carriers]
   size_t RxSyncIntegLen;                     // [FEC Blocks]
   FloatType RxSyncThreshold;                 // [S/N]
+  size_t RxSyncThreads;                      // [threads]
+  size_t RxSyncHardPass;                     // [0/1] acquire with the int8 hard-decision coarse pass
+  size_t RxSyncTrackLen;                     // [FEC blocks] stable lock before the synchronizer only tracks it, 0 => always search
+  size_t RxSyncSoftBits;                     // [bits] store the synchronizer soft bits as int8/int16, 0 => float
+  size_t RxCompactHistory;                   // [0/1] store the spectra history as 16-bit log-energy
+  size_t RxCarrierMajor;                     // [0/1] store the (float) spectra history carrier by carrier
+  size_t RxBandLimit;                        // [0/1] the input processor handles only the band of the signal
+  size_t RxBaseband;                         // [0/1] the input processor passes a decimated complex baseband to the demodulator
+  size_t RxSearchMargin;                     // [MFSK carriers] coarse search beyond RxSyncMargin, 0 => none
+  FloatType RxDetectThreshold;               // [RMS] signal pre-detector threshold on the tone comb significance, 0 => always on
+  size_t RxPipeline[3];                      // [thread] running the input processor, demodulator and decoder stages, 0 => the caller
+  size_t RxEarlyDecode;                      // [0/1] provisional characters from the latest block, confirmed by the delayed decode
+  size_t RxStats;                            // [0/1] collect the per-stage timing statistics of the receiver
 
                                              // fixed parameters
   static const size_t BitsPerCharacter   = 7; // [Bits]
@@ -138,6 +153,7 @@ template <class FloatType=float>
   size_t SymbolSepar;                        // [Samples]
   size_t SymbolLen;                          // [Samples]
   size_t FirstCarrier;                       // [FFT bins]
+  size_t SearchMargin;                       // [MFSK carriers] the larger of RxSyncMargin and RxSearchMargin
 
   MFSK_Parameters()
     { Default(); }
@@ -151,7 +167,20 @@ template <class FloatType=float>
       OutputSampleRate    = SampleRate;
 	  RxSyncIntegLen      = 8;
 	  RxSyncMargin        = 4;
-	  RxSyncThreshold     = 3.0; }
+	  RxSyncThreshold     = 3.0;
+	  RxSyncThreads       = 1;
+	  RxSyncHardPass      = 0;
+	  RxSyncTrackLen      = 0;
+	  RxSyncSoftBits      = 0;
+	  RxCompactHistory    = 0;
+	  RxCarrierMajor      = 0;
+	  RxBandLimit         = 0;
+	  RxBaseband          = 0;
+	  RxSearchMargin      = 0;
+	  RxDetectThreshold   = 0;
+	  RxPipeline[0]=RxPipeline[1]=RxPipeline[2]=0;
+	  RxEarlyDecode       = 0;
+	  RxStats             = 0; }
 
   int Preset(void)
     { 
@@ -175,6 +204,23 @@ template <class FloatType=float>
 
       if(RxSyncMargin>(FirstCarrier/CarrierSepar)) RxSyncMargin=(FirstCarrier/CarrierSepar);
 
+      if(RxSyncThreads<1) RxSyncThreads=1;
+
+      if(RxSearchMargin>(FirstCarrier/CarrierSepar)) RxSearchMargin=(FirstCarrier/CarrierSepar);
+      size_t UpperMargin=((SymbolLen/2)-1-FirstCarrier)/CarrierSepar-(Carriers-1);
+      if(RxSearchMargin>UpperMargin) RxSearchMargin=UpperMargin;
+      SearchMargin = RxSearchMargin>RxSyncMargin ? RxSearchMargin:RxSyncMargin;
+
+      if(RxDetectThreshold<0) RxDetectThreshold=0;
+      if((RxSyncSoftBits!=8)&&(RxSyncSoftBits!=16)) RxSyncSoftBits=0;
+      if(RxCompactHistory) RxCarrierMajor=0;
+
+      if(RxPipeline[0]>1) RxPipeline[0]=1;    // every thread runs the next stage(s) in order
+      size_t Stage;
+      for(Stage=1; Stage<3; Stage++)
+      { if((RxPipeline[Stage]<RxPipeline[Stage-1])||(RxPipeline[Stage]>(RxPipeline[Stage-1]+1)))
+          RxPipeline[Stage]=RxPipeline[Stage-1]; }
+
 	  return 0; }
 
    char *OptionHelp(void)
@@ -185,20 +231,34 @@ template <class FloatType=float>
   -S<threshold>         S/N threshold [3.0]\n\
   -M<margin>            frequency search margin [4]\n\
   -I<period>            synchr. integration period [8]\n\
+  -P<threads>           synchronizer threads [1]\n\
+  -H                    hard-decision (int8) coarse synchronizer pass\n\
+  -A<blocks>            track (not search) after a stable lock that long [0=off]\n\
+  -Q<bits>              quantized synchronizer soft bits: 8, 16 [0=float]\n\
+  -C                    compact (16-bit log-energy) spectra history\n\
+  -K                    carrier-major spectra history layout\n\
+  -F                    band-limited input processor\n\
+  -X                    input processor to demodulator handoff in complex baseband\n\
+  -W<margin>            wide (coarse) frequency search margin [0]\n\
+  -D<level>             signal pre-detector threshold, ~5.0 [0=off]\n\
   -R<Tx>/<Rx>           the true sample rate for Tx and Rx [8000.0/8000.0]\n\
+  -G<map>               pipelined receiver: threads for the input processor,\n\
+                        demodulator and decoder stages, e.g. 012 [000]\n\
+  -E                    early (provisional) decoding of the latest block\n\
+  -V                    per-stage receiver timing statistics\n\
 ";   }
 
    int ReadOption(char *Option)
      { if(Option[0]!='-') return 0;
        switch(Option[1])
        { case 'T':
-          size_t Tones;
+          int Tones;
           if(sscanf(Option+2,"%d",&Tones)==1)
 		  { BitsPerSymbol=Log2(Tones); }
 		  else return -1;
 		  break;
 	     case 'B':
-          size_t Band; float Edge;
+          int Band; float Edge;
           if(sscanf(Option+2,"%d/%f",&Band,&Edge)==2)
 		  { Bandwidth=Band; LowerBandEdge=Edge; }
           else if(sscanf(Option+2,"%d",&Band)==1)
@@ -206,17 +266,74 @@ template <class FloatType=float>
 		  else return -1;
 		  break;
 		 case 'M':
-          size_t Margin;
+          int Margin;
           if(sscanf(Option+2,"%d",&Margin)==1)
 		  { RxSyncMargin=Margin; }
 		  else return -1;
 		  break;
 		 case 'I':
-          size_t IntegLen;
+          int IntegLen;
           if(sscanf(Option+2,"%d",&IntegLen)==1)
 		  { RxSyncIntegLen=IntegLen; }
 		  else return -1;
 		  break;
+		 case 'P':
+          int Threads;
+          if(sscanf(Option+2,"%d",&Threads)==1)
+		  { RxSyncThreads=Threads; }
+		  else return -1;
+		  break;
+		 case 'W':
+          int WideMargin;
+          if(sscanf(Option+2,"%d",&WideMargin)==1)
+		  { RxSearchMargin=WideMargin; }
+		  else return -1;
+		  break;
+		 case 'D':
+          float Level;
+          if(sscanf(Option+2,"%f",&Level)==1)
+		  { RxDetectThreshold=Level; }
+		  else return -1;
+		  break;
+		 case 'H':
+          RxSyncHardPass=1;
+		  break;
+		 case 'A':
+          int TrackLen;
+          if(sscanf(Option+2,"%d",&TrackLen)==1)
+		  { RxSyncTrackLen=TrackLen; }
+		  else return -1;
+		  break;
+		 case 'C':
+          RxCompactHistory=1;
+		  break;
+		 case 'K':
+          RxCarrierMajor=1;
+		  break;
+		 case 'F':
+          RxBandLimit=1;
+		  break;
+		 case 'X':
+          RxBaseband=1;
+		  break;
+		 case 'E':
+          RxEarlyDecode=1;
+		  break;
+		 case 'V':
+          RxStats=1;
+		  break;
+		 case 'Q':
+          int SoftBits;
+          if(sscanf(Option+2,"%d",&SoftBits)==1)
+		  { RxSyncSoftBits=SoftBits; }
+		  else return -1;
+		  break;
+		 case 'G':
+          int Thread[3];
+          if(sscanf(Option+2,"%1d%1d%1d",Thread,Thread+1,Thread+2)==3)
+		  { RxPipeline[0]=Thread[0]; RxPipeline[1]=Thread[1]; RxPipeline[2]=Thread[2]; }
+		  else return -1;
+		  break;
 		 case 'S':
           float Threshold;
           if(sscanf(Option+2,"%f",&Threshold)==1)
@@ -244,8 +361,31 @@ template <class FloatType=float>
 	           SymbolSepar, SymbolLen, FirstCarrier, SpectraPerSymbol, CarrierSepar);
      printf("%d bits/symbol, %5.3f baud, %d symbols/block, %5.3f sec/block\n",
 	           BitsPerSymbol, BaudRate(), SymbolsPerBlock, BlockPeriod() );
-     printf("Synchronizer: +/-%d carriers = +/-%4.1f Hz,  %d blocks = %3.1f sec\n",
-	           RxSyncMargin, RxSyncMargin*CarrierBandwidth(), RxSyncIntegLen, RxSyncIntegLen*BlockPeriod() );
+     printf("Synchronizer: +/-%d carriers = +/-%4.1f Hz,  %d blocks = %3.1f sec%s\n",
+	           RxSyncMargin, RxSyncMargin*CarrierBandwidth(), RxSyncIntegLen, RxSyncIntegLen*BlockPeriod(),
+	           RxSyncHardPass ? ", hard coarse pass":"" );
+     if(RxSyncTrackLen)
+       printf("Synchronizer tracking: after %d blocks of stable lock\n", (int)RxSyncTrackLen);
+     if(SearchMargin>RxSyncMargin)
+       printf("Coarse search: +/-%d carriers = +/-%4.1f Hz\n",
+	           (int)SearchMargin, SearchMargin*CarrierBandwidth() );
+     if(RxDetectThreshold>0)
+       printf("Pre-detector: threshold %3.1f RMS\n", RxDetectThreshold);
+     if(RxSyncSoftBits)
+       printf("Synchronizer soft bits: %d-bit integers\n", (int)RxSyncSoftBits);
+     if(RxCompactHistory)
+       printf("Spectra history: 16-bit log-energy\n");
+     if(RxCarrierMajor)
+       printf("Spectra history: carrier-major\n");
+     if(RxBandLimit||RxBaseband)
+       printf("Input processor: band-limited%s\n", RxBaseband ? ", complex baseband output":"");
+     if(RxPipeline[2])
+       printf("Pipeline: input processor/demodulator/decoder on threads %d/%d/%d\n",
+	           (int)RxPipeline[0], (int)RxPipeline[1], (int)RxPipeline[2]);
+     if(RxEarlyDecode)
+       printf("Early decoding: provisional characters %3.1f sec ahead\n", RxSyncIntegLen*BlockPeriod());
+     if(RxStats)
+       printf("Statistics: per-stage receiver timing\n");
    }
 
    FloatType BaudRate(void)
@@ -258,7 +398,7 @@ template <class FloatType=float>
    { return (FloatType)SampleRate/SymbolLen*CarrierSepar; }
 
    FloatType TuneMargin(void)
-   { return CarrierBandwidth()*RxSyncMargin; }
+   { return CarrierBandwidth()*SearchMargin; }
 
    FloatType BlockPeriod(void)
    { return (SymbolsPerBlock*SymbolSepar)/(FloatType)SampleRate; }
@@ -346,8 +486,7 @@ template <class Type=float>
    Type *CosineTable;     // Cosine table for fast cos/sin calculation
    Type *SymbolShape;     // the shape of the symbol
    int   SymbolPhase;     // the phase of the tone being transmitted
-   Type  *OutTap;         // output tap (buffer)
-   size_t TapPtr;
+   MirrorBuffer<Type> OutTap; // output tap (buffer)
    size_t WrapMask;
 
   public:
@@ -360,13 +499,12 @@ template <class Type=float>
 
    void Init(void)
      { CosineTable=0;
-	   SymbolShape=0;
-       OutTap=0; }
+	   SymbolShape=0; }
 
    void Free(void)
      { free(CosineTable); CosineTable=0;
        free(SymbolShape); SymbolShape=0;
-       free(OutTap); OutTap=0; }
+       OutTap.Free(); }
 
    int Preset(MFSK_Parameters<Type> *NewParameters)
      { Parameters=NewParameters;
@@ -403,10 +541,7 @@ template <class Type=float>
 	       SymbolShape[Time]*=Scale;
 	   }
 
-       if(ReallocArray(&OutTap,SymbolLen)<0) goto Error;
-       for(Idx=0; Idx<SymbolLen; Idx++)
-         OutTap[Idx]=0;
-       TapPtr=0;
+       if(OutTap.Preset(SymbolLen)<0) goto Error;
 
        WrapMask=SymbolLen-1;
        SymbolPhase=0;
@@ -448,36 +583,32 @@ template <class Type=float>
        const int32_t Limit=0x7FFF;
        size_t Idx;
 
+       Type *Tap=OutTap.Window();
        for(Idx=0; Idx<SymbolSepar; Idx++)
-       { Type Ampl=OutTap[TapPtr];
+       { Type Ampl=Tap[Idx];
          Ampl*=Scale;
          int32_t Out=(int32_t)floor(Ampl+0.5);
          if(Out>Limit) Out=Limit;
          else if(Out<(-Limit)) Out=(-Limit);
-         Buffer[Idx]=(int16_t)Out;
-         OutTap[TapPtr]=0;
-         TapPtr+=1; TapPtr&=WrapMask; }
+         Buffer[Idx]=(int16_t)Out; }
+       OutTap.WriteZeros(SymbolSepar);
 
        return SymbolSepar; }
 
    template <class OutType>
     int Output(OutType *Buffer)
-     {  size_t Idx;
-       for(Idx=0; Idx<SymbolSepar; Idx++)
-       { Buffer[Idx]=OutTap[TapPtr];
-         OutTap[TapPtr]=0;
-         TapPtr+=1; TapPtr&=WrapMask; }
+     { OutTap.ReadClear(Buffer,SymbolSepar);
        return SymbolSepar; }
 
   private:
 
    void AddSymbol(int Freq, int Phase)
      { size_t Time;
+       Type *Tap=OutTap.Window();
        for(Time=0; Time<SymbolLen; Time++)
-       { OutTap[TapPtr]+=CosineTable[Phase]*SymbolShape[Time];
-         Phase+=Freq; Phase&=WrapMask;
-         TapPtr+=1; TapPtr&=WrapMask; }
-     }
+       { Tap[Time]+=CosineTable[Phase]*SymbolShape[Time];
+         Phase+=Freq; Phase&=WrapMask; }
+       OutTap.Mirror(0,SymbolLen); }
 
 } ;
 
@@ -534,16 +665,19 @@ template <class Type>
    // the user-settable parameters:
    size_t WindowLen;  // spectral analysis (FFT) window length
    Type LimiterLevel; // limiter level (amplitude) to reduce time and frequency localised interference
+   size_t BandStart;  // the band of interest [FFT bins], BandStop=0 => the whole spectrum:
+   size_t BandStop;   // other frequencies are removed, saving the work on them
+   size_t BasebandStart; // output the spectral bins [BasebandStart..BasebandStart+BasebandLen)
+   size_t BasebandLen;   // as a complex signal decimated by WindowLen/BasebandLen, BasebandLen=0 => real output
 
   public:
 
-   size_t WrapMask;   // wrap mask for buffer addressing
-
-   Type *InpTap;      // input buffer for analysis window
-   size_t InpTapPtr;
+   size_t EqualStart; // spectral range which is equalized [FFT bins]:
+   size_t EqualStop;  // the band plus a guard for the averaging filters
+   size_t FillStop;   // equalizer output extends up to here
 
-   Type *OutTap;      // output buffer for reconstruction window
-   size_t OutTapPtr;
+   MirrorBuffer<Type> InpTap;  // input buffer for analysis window
+   MirrorBuffer<Type> OutTap;  // output buffer for reconstruction window
 
    Type *WindowShape; // analysis/reconstruction window shape
 
@@ -559,7 +693,13 @@ template <class Type>
 
    Type *Energy;            // energy vs frequency
 
-   BoxFilter<Type> Filter;  // spectra energy averaging filter
+   Type *EnergyTap;         // copy of Energy for the running (box) averages
+
+   size_t Decimate;                  // WindowLen/BasebandLen
+   r2FFT< Cmpx<Type> > BasebandFFT;  // BasebandLen-point FFT engine
+   Cmpx<Type> *BasebandBuff;         // its buffer
+   MirrorBuffer< Cmpx<Type> > BasebandTap; // overlap-add buffer for the complex output
+   Cmpx<Type> *BasebandOutput;       // [BasebandLen] complex baseband output (instead of Output)
 
   public:
    MFSK_InputProcessor()
@@ -570,44 +710,45 @@ template <class Type>
    { Free(); }
    
    void Init(void)
-     { InpTap=0;
-       OutTap=0;
-	   WindowShape=0;
+     { WindowShape=0;
 	   FFT_Buff=0;
        Spectra[0]=0;
 	   Spectra[1]=0;
 	   Output=0;
-       Energy=0; }
+       Energy=0;
+       EnergyTap=0;
+       BasebandBuff=0;
+       BasebandOutput=0; }
 
    void Free(void)
-     { free(InpTap); InpTap=0;
-       free(OutTap); OutTap=0;
+     { InpTap.Free();
+       OutTap.Free();
 	   free(WindowShape); WindowShape=0;
 	   free(FFT_Buff); FFT_Buff=0;
 	   free(Spectra[0]); Spectra[0]=0;
        free(Spectra[1]); Spectra[1]=0;
 	   free(Output); Output=0;
 	   free(Energy); Energy=0;
-       FFT.Free();
-       Filter.Free(); }
+       free(EnergyTap); EnergyTap=0;
+       free(BasebandBuff); BasebandBuff=0;
+       BasebandTap.Free();
+       free(BasebandOutput); BasebandOutput=0;
+       BasebandFFT.Free();
+       FFT.Free(); }
 
    void Default(void)
      { WindowLen=8192;
-	   LimiterLevel=2.5; }
+	   LimiterLevel=2.5;
+       BandStart=0; BandStop=0;
+       BasebandStart=0; BasebandLen=0; }
      
    int Preset(void)
      { size_t Idx;
 
-       WrapMask=WindowLen-1;
-
        Type ShapeScale=2.0/WindowLen;
 
-       if(ReallocArray(&InpTap,WindowLen)<0) goto Error;
-       ClearArray(InpTap,WindowLen);
-       InpTapPtr=0;
-       if(ReallocArray(&OutTap,WindowLen)<0) goto Error;
-       ClearArray(OutTap,WindowLen);
-       OutTapPtr=0;
+       if(InpTap.Preset(WindowLen)<0) goto Error;
+       if(OutTap.Preset(WindowLen)<0) goto Error;
 
        if(FFT.Preset(WindowLen)<0) goto Error;
        if(ReallocArray(&FFT_Buff,WindowLen)<0) goto Error;
@@ -625,35 +766,66 @@ template <class Type>
        ClearArray(Output,WindowLen);
 
        if(ReallocArray(&Energy,SpectraLen)<0) goto Error;
-
-       Filter.Len=WindowLen/16;
-       if(Filter.Preset()<0) goto Error;
+       if(ReallocArray(&EnergyTap,SpectraLen)<0) goto Error;
+
+       EqualStart=0; EqualStop=3*(SpectraLen/4); FillStop=SpectraLen;
+       if(BandStop>BandStart)
+       { size_t Guard=(3*(WindowLen/64)+(WindowLen/96)+(WindowLen/64))/2+1; // reach of the averaging passes
+         size_t MinWidth=2*Guard;                // the filters need at least their length
+         EqualStart = BandStart>Guard ? BandStart-Guard:0;
+         EqualStop = BandStop+Guard;
+         if(EqualStop<(EqualStart+MinWidth)) EqualStop=EqualStart+MinWidth;
+         if(EqualStop>(3*(SpectraLen/4))) EqualStop=3*(SpectraLen/4);
+         if(EqualStart+MinWidth>EqualStop) EqualStart = EqualStop>MinWidth ? EqualStop-MinWidth:0;
+         FillStop=EqualStop; }
+
+       if(BasebandLen)
+       { if((BasebandStart+BasebandLen)>SpectraLen) goto Error;
+         Decimate=WindowLen/BasebandLen;
+         if(BasebandFFT.Preset(BasebandLen)<0) goto Error;
+         if(ReallocArray(&BasebandBuff,BasebandLen)<0) goto Error;
+         if(BasebandTap.Preset(BasebandLen)<0) goto Error;
+         if(ReallocArray(&BasebandOutput,BasebandLen)<0) goto Error;
+         ClearArray(BasebandOutput,BasebandLen); }
 
        return 0;
        
        Error: Free(); return -1; }
 
    void Reset(void)
-     { ClearArray(InpTap,WindowLen);
-       InpTapPtr=0;
-       ClearArray(OutTap,WindowLen);
-       OutTapPtr=0; }
-
+     { InpTap.Reset();
+       OutTap.Reset();
+       if(BasebandLen) BasebandTap.Reset(); }
+
+   // save (Load=0) or load (Load=1) the taps, the processor must be preset the same
+   int StateIO(FILE *File, int Load)
+     { if(InpTap.StateIO(File,Load)<0) return -1;
+       if(OutTap.StateIO(File,Load)<0) return -1;
+       if(BasebandLen) return BasebandTap.StateIO(File,Load);
+       return 0; }
+
+   // the output length of one Process() call [samples]
+   size_t OutputLen(void) const
+     { return BasebandLen ? BasebandLen:WindowLen; }
+
+   // the box averages run over the energies as they were before the pass,
+   // thus the sum takes them from EnergyTap, while Energy is being modified
    void LimitSpectraPeaks(Cmpx<Type> *Spectra, size_t BoxLen=64)
-     { Filter.Len=BoxLen;
-       Filter.Preset();
-
-       size_t MaxFreq = 3*(SpectraLen/4);
+     { size_t MaxFreq = EqualStop;
        size_t Freq,Idx;
+       Type *Tap=EnergyTap;
+       CopyArray(Tap+EqualStart,Energy+EqualStart,MaxFreq-EqualStart);
 
-       for(Freq=0; Freq<BoxLen; Freq++)
-         Filter.Process(Energy[Freq]);
+       double Sum=0;
+       for(Freq=EqualStart; Freq<(EqualStart+BoxLen); Freq++)
+         Sum+=Tap[Freq];
 
        Type Threshold=LimiterLevel*LimiterLevel;
-       for(Idx=BoxLen/2; Freq<MaxFreq; Freq++,Idx++)
-       { Filter.Process(Energy[Freq]);
-         Type Signal = Energy[Idx];
-         Type Limit=(Filter.Output/BoxLen)*Threshold;
+       for(Idx=EqualStart+BoxLen/2; Freq<MaxFreq; Freq++,Idx++)
+       { Sum-=Tap[Freq-BoxLen];
+         Sum+=Tap[Freq];
+         Type Signal = Tap[Idx];
+         Type Limit=(Sum/BoxLen)*Threshold;
          if(Signal>Limit)
          { Spectra[Idx]*=sqrt(Limit/Signal);
            Energy[Idx]=Limit; }
@@ -682,26 +854,29 @@ template <class Type>
      }
 
    void AverageEnergy(size_t Len=32)
-     { Filter.Len=Len;
-       Filter.Preset();
-
-       size_t MaxFreq = 3*(SpectraLen/4);
+     { size_t MaxFreq = EqualStop;
        Type Scale=1.0/Len;
        size_t Len2=Len/2;
        size_t Idx,Freq;
+       Type *Tap=EnergyTap;
+       CopyArray(Tap+EqualStart,Energy+EqualStart,MaxFreq-EqualStart);
 
-       for(Freq=0; Freq<Len; Freq++)
-         Filter.Process(Energy[Freq]);
+       double Sum=0;
+       for(Freq=EqualStart; Freq<(EqualStart+Len); Freq++)
+         Sum+=Tap[Freq];
 
-       for(Idx=0; Idx<Len2; Idx++)
-         Energy[Idx]=Filter.Output*Scale;
+       Type Average=Sum*Scale;
+       for(Idx=EqualStart; Idx<(EqualStart+Len2); Idx++)
+         Energy[Idx]=Average;
 
        for(      ; Freq<MaxFreq; Freq++,Idx++)
-       { Filter.Process(Energy[Freq]);
-         Energy[Idx]=Filter.Output*Scale; }
+       { Sum-=Tap[Freq-Len];
+         Sum+=Tap[Freq];
+         Energy[Idx]=Sum*Scale; }
 
-       for(      ; Idx<SpectraLen; Idx++)
-         Energy[Idx]=Filter.Output*Scale;
+       Average=Sum*Scale;
+       for(      ; Idx<FillStop; Idx++)
+         Energy[Idx]=Average;
 
      }
 
@@ -709,8 +884,7 @@ template <class Type>
    void ProcessSpectra(Cmpx<Type> *Spectra)
      { size_t Freq;
 
-       for(Freq=0; Freq<SpectraLen; Freq++)
-       { Energy[Freq]=Spectra[Freq].Energy(); }
+       SpectraEnergy(Energy+EqualStart,Spectra+EqualStart,EqualStop-EqualStart);
 
        LimitSpectraPeaks(Spectra,WindowLen/64);
        LimitSpectraPeaks(Spectra,WindowLen/64);
@@ -719,63 +893,80 @@ template <class Type>
        AverageEnergy(WindowLen/96);
        AverageEnergy(WindowLen/64);
 
-       for(Freq=0; Freq<SpectraLen; Freq++)
+       Type *Energy=this->Energy;
+       for(Freq=EqualStart; Freq<FillStop; Freq++)
        { Type Corr=Energy[Freq];
-         if(Corr<=0) continue;
-         Corr=1.0/sqrt(Corr);
-         Spectra[Freq]*=Corr; }
+         Corr = Corr>0 ? (Type)(1.0/sqrt(Corr)):(Type)1.0;
+         Spectra[Freq].Re*=Corr;
+         Spectra[Freq].Im*=Corr; }
+
+       for(Freq=0; Freq<EqualStart; Freq++)     // outside the band (when band-limited)
+         Spectra[Freq]=0;
+       for(Freq=FillStop; Freq<SpectraLen; Freq++)
+         Spectra[Freq]=0;
 
      }
 
    template <class InpType>
     void ProcessInpTap(InpType *Input)
-     { size_t InpIdx;
-       for(InpIdx=0; InpIdx<SliceSepar; InpIdx++)
-       { InpTap[InpTapPtr]=Input[InpIdx];
-         InpTapPtr+=1; InpTapPtr&=WrapMask; }
-     }
+     { InpTap.Write(Input,SliceSepar); }
 
    void ProcessInpTap()
-     { size_t InpIdx;
-       for(InpIdx=0; InpIdx<SliceSepar; InpIdx++)
-       { InpTap[InpTapPtr]=0;
-         InpTapPtr+=1; InpTapPtr&=WrapMask; }
-     }
+     { InpTap.WriteZeros(SliceSepar); }
 
+   // the window spans the whole tap, which starts at the current pointer
    void ProcessInpWindow_Re(void)
-     { size_t Time;
-       for(Time=0; Time<WindowLen; Time++)
-       { FFT_Buff[Time].Re=InpTap[InpTapPtr]*WindowShape[Time];
-         InpTapPtr+=1; InpTapPtr&=WrapMask; }
-     }
+     { WindowTap<0>(FFT_Buff,InpTap.Window(),WindowLen,WindowShape); }
 
    void ProcessInpWindow_Im(void)
-     { size_t Time;
-       for(Time=0; Time<WindowLen; Time++)
-       { FFT_Buff[Time].Im=InpTap[InpTapPtr]*WindowShape[Time];
-         InpTapPtr+=1; InpTapPtr&=WrapMask; }
-     }
+     { WindowTap<1>(FFT_Buff,InpTap.Window(),WindowLen,WindowShape); }
 
    void ProcessOutWindow_Re(void)
-     { size_t Time;
-       for(Time=0; Time<WindowLen; Time++)
-       { OutTap[OutTapPtr]+=FFT_Buff[Time].Re*WindowShape[Time];
-         OutTapPtr+=1; OutTapPtr&=WrapMask; }
-     }
+     { OverlapAddTap<0>(OutTap.Window(),WindowLen,FFT_Buff,WindowShape);
+       OutTap.Mirror(0,WindowLen); }
 
    void ProcessOutWindow_Im(void)
-     { size_t Time;
-       for(Time=0; Time<WindowLen; Time++)
-       { OutTap[OutTapPtr]+=FFT_Buff[Time].Im*WindowShape[Time];
-         OutTapPtr+=1; OutTapPtr&=WrapMask; }
-     }
+     { OverlapAddTap<1>(OutTap.Window(),WindowLen,FFT_Buff,WindowShape);
+       OutTap.Mirror(0,WindowLen); }
 
    void ProcessOutTap(Type *Output)
-     { size_t OutIdx;
-       for(OutIdx=0; OutIdx<SliceSepar; OutIdx++)
-       { Output[OutIdx]=OutTap[OutTapPtr];
-         OutTap[OutTapPtr]=0;
-         OutTapPtr+=1; OutTapPtr&=WrapMask; }
+     { OutTap.ReadClear(Output,SliceSepar); }
+
+   // the (positive) bins of interest of one processed spectra back to time domain:
+   // as the input spectra is twice the FFT of the real signal, the result is its analytic signal,
+   // decimated and shifted down in frequency by BasebandStart bins
+   void ProcessBasebandWindow(Cmpx<Type> *Spectra)
+     { size_t Idx;
+       Cmpx<Type> *Band=Spectra+BasebandStart;
+       for(Idx=0; Idx<BasebandLen; Idx++)                  // the FFT engine transforms forward only
+       { BasebandBuff[Idx].Re=Band[Idx].Re;                // thus conjugate at input and output
+         BasebandBuff[Idx].Im=(-Band[Idx].Im); }
+       if(BasebandStart==0) BasebandBuff[0].Im=0;          // the Nyquist bin is packed there
+       BasebandFFT.Process(BasebandBuff);
+       Cmpx<Type> *Tap=BasebandTap.Window();
+       for(Idx=0; Idx<BasebandLen; Idx++)
+       { Type Shape=WindowShape[Idx*Decimate];
+         Tap[Idx].Re+=BasebandBuff[Idx].Re*Shape;
+         Tap[Idx].Im-=BasebandBuff[Idx].Im*Shape; }
+       BasebandTap.Mirror(0,BasebandLen); }
+
+   void ProcessBasebandTap(Cmpx<Type> *Output)
+     { BasebandTap.ReadClear(Output,BasebandLen/2); }
+
+   // like LimitOutputPeaks() but on the envelope of the complex output:
+   // the real signal is twice the real part, thus the same level is 1/sqrt(2) of the RMS
+   void LimitBasebandPeaks(void)
+     { size_t Idx;
+       Type RMS=0;
+       for(Idx=0; Idx<BasebandLen; Idx++)
+         RMS+=BasebandOutput[Idx].Energy();
+       RMS=sqrt(RMS/BasebandLen);
+       Type Limit=RMS*LimiterLevel*sqrt(0.5);
+       Type Limit2=Limit*Limit;
+
+       for(Idx=0; Idx<BasebandLen; Idx++)
+       { Type Energy=BasebandOutput[Idx].Energy();
+         if(Energy>Limit2) BasebandOutput[Idx]*=Limit/sqrt(Energy); }
      }
 
    template <class InpType>
@@ -794,6 +985,15 @@ template <class Type>
        ProcessSpectra(Spectra[0]);
        ProcessSpectra(Spectra[1]);
 
+       if(BasebandLen)                             // no inverse FFT of the whole spectra
+       { ProcessBasebandWindow(Spectra[0]);
+         ProcessBasebandTap(BasebandOutput);
+         ProcessBasebandWindow(Spectra[1]);
+         ProcessBasebandTap(BasebandOutput+BasebandLen/2);
+         LimitBasebandPeaks();
+         LimitBasebandPeaks();
+         return BasebandLen; }
+
        FFT.JoinTwoReals(Spectra[0], Spectra[1], FFT_Buff);
        FFT.Process(FFT_Buff);
 
@@ -827,6 +1027,56 @@ template <class Type>
 
 // =====================================================================
 
+// Compact storage for the (non-negative) energies: the exponent and the top 8 bits
+// of the mantissa of a float form a piecewise-linear log2 scale with 1/256 octave steps,
+// thus 16 bits keep the full range at 0.2% resolution.
+
+inline uint16_t LogEnergyCode(float Energy)
+{ uint32_t Bits; memcpy(&Bits,&Energy,sizeof(Bits));
+  if(Bits&0x80000000) return 0;                   // negative: should not happen
+  Bits+=0x4000;                                   // round to the nearest code
+  if(Bits>=0x7FFF8000) return 0xFFFF;
+  return Bits>>15; }
+
+inline float LogEnergyValue(uint16_t Code)
+{ uint32_t Bits=(uint32_t)Code<<15;
+  float Energy; memcpy(&Energy,&Bits,sizeof(Energy));
+  return Energy; }
+
+// A view of the spectral energies of a FEC block right in the demodulator history:
+// the tones of symbol Symbol are at SymbolPtr(Symbol)[Tone*ToneStride].
+// The same view describes a plain [Symbol][Tone] array.
+
+template <class Type=float>
+ class MFSK_SpectraView
+{ public:
+
+   Type *Data;            // the first tone in the first row of the storage
+   size_t Rows;           // number of rows (time slices) before wrapping around
+   size_t RowStride;      // [elements] between rows
+   size_t FirstRow;       // the row of the first symbol
+   size_t RowStep;        // [rows] between symbols
+   size_t ToneStride;     // [elements] between tones
+
+  public:
+
+   MFSK_SpectraView()
+     { Data=0; }
+
+   // view a plain array of Symbols x Tones
+   void Set(Type *NewData, size_t Symbols, size_t Tones)
+     { Data=NewData;
+       Rows=Symbols; RowStride=Tones;
+       FirstRow=0; RowStep=1;
+       ToneStride=1; }
+
+   Type *SymbolPtr(size_t Symbol)
+     { size_t Row=FirstRow+Symbol*RowStep;
+       if(Row>=Rows) Row-=Rows;
+       return Data+Row*RowStride; }
+
+} ;
+
 // front-end spectral analysis and soft decoder for MFSK
 template <class Type=float>
  class MFSK_Demodulator
@@ -838,21 +1088,27 @@ template <class Type=float>
 
    size_t InputLen;       // input must be provided in batches of that length [samples]
 
+   // the user-settable parameters:
+   size_t Decimate;       // 1 => real input, otherwise complex baseband input decimated by that factor
+   size_t BasebandShift;  // and shifted down in frequency by that many FFT bins
+
+   Type *SliceOutput;     // when set: Process() appends the slice energies here (for StoreSlice() elsewhere),
+                          // instead of storing them into the history
+
   private:
 
    size_t SymbolSepar;
    size_t SymbolLen;
    size_t SpectraPerSymbol;
+   size_t BasebandLen;    // FFT length for the complex baseband input
 
    size_t DecodeMargin;   // frequency margin for decoding the signal [FFT bins]
    size_t DecodeWidth;    // Spectra width                            [FFT bins]
 
    size_t SliceSepar;     // time separation between samples          [samples]
 
-   size_t WrapMask;                     // wrapping mask for the FFT window
-
-   Type *InpTap;                        // input buffer
-   size_t InpTapPtr;
+   MirrorBuffer<Type> InpTap;           // input buffer
+   MirrorBuffer< Cmpx<Type> > BasebandTap; // or the input buffer for the complex baseband
 
    Type *SymbolShape;                   // the shape of the symbol and the FFT window
 
@@ -864,29 +1120,45 @@ template <class Type=float>
 
    CircularBuffer<Type> History;         // Spectra history
 
+   int CarrierMajor;                     // History is stored as [DecodeWidth][Len]
+   int CompactHistory;                   // use History16 instead of History:
+   CircularBuffer<uint16_t> History16;   // Spectra history as LogEnergyCode()
+   Type *SliceBuffer;                    // [DecodeWidth] one slice of History16 or carrier-major History
+   size_t SliceRow;                      // the history row in SliceBuffer, HistoryLen => none
+   size_t HistoryLen;                    // [rows] length of the history (either buffer)
+
   public:
 
    MFSK_Demodulator()
-   { Init(); }
+   { Init();
+     Default(); }
 
    ~MFSK_Demodulator()
    { Free(); }
    
    void Init(void)
-     { InpTap=0;
-	   SymbolShape=0;
+     { SymbolShape=0;
 	   FFT_Buff=0;
        Spectra[0]=0;
-	   Spectra[1]=0; }
+	   Spectra[1]=0;
+	   SliceBuffer=0;
+       SliceOutput=0; }
 
    void Free(void)
-     { free(InpTap); InpTap=0;
+     { InpTap.Free();
+       BasebandTap.Free();
 	   free(SymbolShape); SymbolShape=0;
 	   free(FFT_Buff); FFT_Buff=0;
 	   free(Spectra[0]); Spectra[0]=0;
        free(Spectra[1]); Spectra[1]=0;
        FFT.Free();
-       History.Free(); }
+       History.Free();
+       History16.Free();
+       free(SliceBuffer); SliceBuffer=0; }
+
+   void Default(void)
+     { Decimate=1;
+       BasebandShift=0; }
 
    int Preset(MFSK_Parameters<Type> *NewParameters)
      {
@@ -897,15 +1169,11 @@ template <class Type=float>
 	   SpectraPerSymbol=Parameters->SpectraPerSymbol;
 
        InputLen=SymbolSepar;
-       DecodeMargin=Parameters->RxSyncMargin*Parameters->CarrierSepar;
-
-       WrapMask=SymbolLen-1;
+       DecodeMargin=Parameters->SearchMargin*Parameters->CarrierSepar;
 
        Type ShapeScale=1.0/SymbolLen;
 
-       if(ReallocArray(&InpTap,SymbolLen)<0) goto Error;
-       ClearArray(InpTap,SymbolLen);
-       InpTapPtr=0;
+       if(InpTap.Preset(SymbolLen)<0) goto Error;
 
        if(FFT.Preset(SymbolLen)<0) goto Error;
        if(ReallocArray(&FFT_Buff,SymbolLen)<0) goto Error;
@@ -933,66 +1201,192 @@ template <class Type=float>
 	       SymbolShape[Time]*=ShapeScale;
 	   }
 
+       if(Decimate>1)                   // complex baseband: the same window, decimated
+       { BasebandLen=SymbolLen/Decimate;
+         InputLen=SymbolSepar/Decimate;
+         SliceSepar/=Decimate;
+         size_t Time;
+         for(Time=0; Time<BasebandLen; Time++)   // x2 as SeparTwoReals() and x Decimate for the shorter sum
+           SymbolShape[Time]=SymbolShape[Time*Decimate]*(2*Decimate);
+         if(FFT.Preset(BasebandLen)<0) goto Error;
+         if(BasebandTap.Preset(BasebandLen)<0) goto Error; }
+       else
+       { Decimate=1; BasebandShift=0; }
+
        SpectraLen=SymbolLen/2;
        if(ReallocArray(&Spectra[0],SpectraLen)<0) goto Error;
        if(ReallocArray(&Spectra[1],SpectraLen)<0) goto Error;
 
        DecodeWidth=((Parameters->Carriers-1)*Parameters->CarrierSepar+1) + 2*DecodeMargin;
 
-       History.Len=(Parameters->RxSyncIntegLen+2)*Parameters->SpectraPerBlock;
-       History.Width=DecodeWidth;
-       if(History.Preset()<0) goto Error;
-       History.Clear();
+       HistoryLen=(Parameters->RxSyncIntegLen+2)*Parameters->SpectraPerBlock;
+       if(Parameters->RxSyncHardPass)       // the synchronizer replays from further back on a coarse pass candidate
+         HistoryLen+=(Parameters->RxSyncIntegLen+1)*Parameters->SpectraPerBlock;
+       CompactHistory=Parameters->RxCompactHistory;
+       CarrierMajor=Parameters->RxCarrierMajor && (!CompactHistory);
+       if(CompactHistory)
+       { History.Free();
+         History16.Len=HistoryLen;
+         History16.Width=DecodeWidth;
+         if(History16.Preset()<0) goto Error; }
+       else
+       { History16.Free();
+         History.Len=HistoryLen;
+         History.Width=DecodeWidth;
+         if(History.Preset()<0) goto Error; }
+       if(CompactHistory||CarrierMajor)
+       { if(ReallocArray(&SliceBuffer,DecodeWidth)<0) goto Error; }
+       Reset();
 
        return 0;
        
        Error: Free(); return -1; }
 
    void Reset(void)
-     { History.Clear(); }
-
+     { if(CompactHistory) History16.Clear();
+                     else History.Clear();
+       SliceRow=HistoryLen; }
+
+   // save (Load=0) or load (Load=1) the input tap and the Rows latest slices of the history
+   // (the rest is cleared on load), the demodulator must be preset the same
+   int StateIO(FILE *File, int Load, size_t Rows)
+     { SliceRow=HistoryLen;
+       if(Decimate>1) { if(BasebandTap.StateIO(File,Load)<0) return -1; }
+                 else { if(InpTap.StateIO(File,Load)<0) return -1; }
+       if(Rows>HistoryLen) Rows=HistoryLen;
+       if(CompactHistory) return History16.StateIO(File,Load,Rows);
+       if(!CarrierMajor) return History.StateIO(File,Load,Rows);
+       if(Load) History.Clear();                     // carrier-major: the rows are a circular span for every frequency
+       if(StateArray(File,Load,&History.Ptr,1)<0) return -1;
+       if(History.Ptr>=HistoryLen) { History.Ptr=0; return -1; }
+       size_t Start=HistoryRow(-(int)Rows);
+       size_t First = (Start+Rows)<=HistoryLen ? Rows : HistoryLen-Start;
+       size_t Freq;
+       for(Freq=0; Freq<DecodeWidth; Freq++)
+       { Type *Hist=History.Data+Freq*HistoryLen;
+         if(StateArray(File,Load,Hist+Start,First)<0) return -1;
+         if(StateArray(File,Load,Hist,Rows-First)<0) return -1; }
+       return 0; }
+
+   // the history row of the slice Idx, Idx<0 => past slices
+   size_t HistoryRow(int Idx)
+     { int Row=(int)(CompactHistory ? History16.Ptr:History.Ptr)+Idx;
+       if(Row<0) Row+=HistoryLen;
+       else if(Row>=(int)HistoryLen) Row-=HistoryLen;
+       return Row; }
+
+   // a slice of the spectra history, Idx<0 => past slices
+   // (for the compact or carrier-major history the pointer is valid until the next call or Process())
    Type *HistoryPtr(int Idx)
-     { return History.OffsetPtr(Idx); }
+     { if(!(CompactHistory||CarrierMajor)) return History.OffsetPtr(Idx);
+       size_t Row=HistoryRow(Idx);
+       if(Row!=SliceRow)                     // convert only once for all the readers of a slice
+       { size_t Freq;
+         if(CompactHistory)
+         { uint16_t *Hist=History16.Data+Row*DecodeWidth;
+           for(Freq=0; Freq<DecodeWidth; Freq++)
+             SliceBuffer[Freq]=LogEnergyValue(Hist[Freq]); }
+         else
+         { Type *Hist=History.Data+Row;
+           for(Freq=0; Freq<DecodeWidth; Freq++, Hist+=HistoryLen)
+             SliceBuffer[Freq]=(*Hist); }
+         SliceRow=Row; }
+       return SliceBuffer; }
 
    template <class InpType>
     int SlideOneSlice(InpType *Input)
-	 { size_t InpIdx;
-       for(InpIdx=0; InpIdx<SliceSepar; InpIdx++)
-       { InpTap[InpTapPtr]=Input[InpIdx];
-         InpTapPtr+=1; InpTapPtr&=WrapMask; }
+	 { InpTap.Write(Input,SliceSepar);
 	   return SliceSepar; }
 
+   // the length of one slice [FFT bins]
+   size_t SliceLen(void) const
+     { return DecodeWidth; }
+
+   // [slices] how far back the history goes
+   size_t HistorySlices(void) const
+     { return HistoryLen; }
+
+   // store one slice of energies into the history
+   void StoreSlice(Type *Energy)
+     { size_t Idx;
+       if(CompactHistory)
+       { uint16_t *Data = History16.OffsetPtr(0);
+         for(Idx=0; Idx<DecodeWidth; Idx++)
+           Data[Idx]=LogEnergyCode(Energy[Idx]);
+         History16+=1; }
+       else if(CarrierMajor)
+       { Type *Data = History.Data+HistoryRow(0);
+         size_t Ofs;
+         for(Idx=0, Ofs=0; Idx<DecodeWidth; Idx++, Ofs+=HistoryLen)
+           Data[Ofs]=Energy[Idx];
+         History+=1; }
+       else
+       { CopyArray(History.OffsetPtr(0),Energy,DecodeWidth);
+         History+=1; }
+       SliceRow=HistoryLen; }
+
+   // store one spectral slice (starting at the first bin of the decode width) into the history
+   void StoreSlice(Cmpx<Type> *Spectra)
+     { size_t Idx;
+       if(SliceOutput)
+       { SpectraEnergy(SliceOutput,Spectra,DecodeWidth);
+         SliceOutput+=DecodeWidth;
+         return; }
+       if(CompactHistory)
+       { uint16_t *Data = History16.OffsetPtr(0);
+         for(Idx=0; Idx<DecodeWidth; Idx++)
+           Data[Idx]=LogEnergyCode(Spectra[Idx].Energy());
+         History16+=1; }
+       else if(CarrierMajor)
+       { Type *Data = History.Data+HistoryRow(0);
+         size_t Ofs;
+         for(Idx=0, Ofs=0; Idx<DecodeWidth; Idx++, Ofs+=HistoryLen)
+           Data[Ofs]=Spectra[Idx].Energy();
+         History+=1; }
+       else
+       { SpectraEnergy(History.OffsetPtr(0),Spectra,DecodeWidth);
+         History+=1; }
+       SliceRow=HistoryLen; }
+
+   // process a batch of the complex baseband input (when Decimate>1)
+   void Process(Cmpx<Type> *Input)
+     { size_t InpIdx,Time,Slice;
+
+       for(InpIdx=0, Slice=0; Slice<SpectraPerSymbol; Slice++)
+	   { BasebandTap.Write(Input+InpIdx,SliceSepar);
+         InpIdx+=SliceSepar;
+
+         Cmpx<Type> *Tap=BasebandTap.Window();
+         for(Time=0; Time<BasebandLen; Time++)
+         { FFT_Buff[Time]=Tap[Time];
+           FFT_Buff[Time]*=SymbolShape[Time]; }
+
+         FFT.Process(FFT_Buff);
+         StoreSlice(FFT_Buff+Parameters->FirstCarrier-DecodeMargin-BasebandShift);
+       }
+
+     }
+
    template <class InpType>
     void Process(InpType *Input)
-     { size_t InpIdx,Time,Slice;
+     { size_t InpIdx,Slice;
 
        for(InpIdx=0, Slice=0; Slice<SpectraPerSymbol; Slice+=2)
 	   { 
 	     InpIdx+=SlideOneSlice(Input+InpIdx);
 
-         for(Time=0; Time<SymbolLen; Time++)
-         { FFT_Buff[Time].Re=InpTap[InpTapPtr]*SymbolShape[Time];
-           InpTapPtr+=1; InpTapPtr&=WrapMask; }
+         WindowTap<0>(FFT_Buff,InpTap.Window(),SymbolLen,SymbolShape);
 
 	     InpIdx+=SlideOneSlice(Input+InpIdx);
 
-         for(Time=0; Time<SymbolLen; Time++)
-         { FFT_Buff[Time].Im=InpTap[InpTapPtr]*SymbolShape[Time];
-           InpTapPtr+=1; InpTapPtr&=WrapMask; }
+         WindowTap<1>(FFT_Buff,InpTap.Window(),SymbolLen,SymbolShape);
 
          FFT.Process(FFT_Buff);
          FFT.SeparTwoReals(FFT_Buff, Spectra[0], Spectra[1]);
 
-         Type *Data0 = History.OffsetPtr(0);
-         Type *Data1 = History.OffsetPtr(1);
-
-         size_t Idx;
-         size_t Freq=Parameters->FirstCarrier-DecodeMargin;
-         for(Idx=0; Idx<DecodeWidth; Idx++, Freq++)
-         { Data0[Idx]=Spectra[0][Freq].Energy();
-           Data1[Idx]=Spectra[1][Freq].Energy(); }
-
-         History+=2;
+         size_t First=Parameters->FirstCarrier-DecodeMargin;
+         StoreSlice(Spectra[0]+First);
+         StoreSlice(Spectra[1]+First);
        }
 
      }
@@ -1000,7 +1394,7 @@ template <class Type=float>
    template <class OutType>
     int PickBlock(OutType *Spectra, int TimeOffset, int FreqOffset)
      { int SpectraPerBlock=Parameters->SpectraPerBlock;
- 	   if((TimeOffset>(-SpectraPerBlock))||((-TimeOffset)>(int)History.Len)) return -1;
+ 	   if((TimeOffset>(-SpectraPerBlock))||((-TimeOffset)>(int)HistoryLen)) return -1;
 
        size_t Carriers=Parameters->Carriers;
        size_t CarrierSepar=Parameters->CarrierSepar;
@@ -1009,6 +1403,24 @@ template <class Type=float>
 
        size_t SymbolsPerBlock=Parameters->SymbolsPerBlock;
 	   size_t Symbol;
+       if(CompactHistory)
+       { for(Symbol=0; Symbol<SymbolsPerBlock; Symbol++, TimeOffset+=SpectraPerSymbol)
+         { uint16_t *Hist=History16.OffsetPtr(TimeOffset)+FreqOffset;
+	       size_t Freq;
+           for(Freq=0; Freq<Carriers; Freq++,Hist+=CarrierSepar)
+		     (*Spectra++)=LogEnergyValue(*Hist);
+	     }
+         return 0; }
+
+       if(CarrierMajor)
+       { for(Symbol=0; Symbol<SymbolsPerBlock; Symbol++, TimeOffset+=SpectraPerSymbol)
+         { Type *Hist=History.Data+HistoryRow(TimeOffset)+FreqOffset*HistoryLen;
+	       size_t Freq;
+           for(Freq=0; Freq<Carriers; Freq++,Hist+=CarrierSepar*HistoryLen)
+		     (*Spectra++)=(*Hist);
+	     }
+         return 0; }
+
        for(Symbol=0; Symbol<SymbolsPerBlock; Symbol++, TimeOffset+=SpectraPerSymbol)
        { Type *Hist=History.OffsetPtr(TimeOffset)+FreqOffset;
 	     size_t Freq;
@@ -1018,6 +1430,32 @@ template <class Type=float>
 
 	   return 0; }
 
+   // same as PickBlock() but without copying: View points right into the history,
+   // returns -2 when the history can not be viewed as Type (compact history)
+   int PickView(MFSK_SpectraView<Type> &View, int TimeOffset, int FreqOffset)
+     { if(CompactHistory) return -2;
+       int SpectraPerBlock=Parameters->SpectraPerBlock;
+ 	   if((TimeOffset>(-SpectraPerBlock))||((-TimeOffset)>(int)HistoryLen)) return -1;
+
+       size_t Carriers=Parameters->Carriers;
+       size_t CarrierSepar=Parameters->CarrierSepar;
+
+       if((FreqOffset<0)||((FreqOffset+(Carriers-1)*CarrierSepar)>=DecodeWidth)) return -1;
+
+       View.Rows=HistoryLen;
+       View.FirstRow=HistoryRow(TimeOffset);
+       View.RowStep=SpectraPerSymbol;
+       if(CarrierMajor)
+       { View.Data=History.Data+FreqOffset*HistoryLen;
+         View.RowStride=1;
+         View.ToneStride=CarrierSepar*HistoryLen; }
+       else
+       { View.Data=History.Data+FreqOffset;
+         View.RowStride=DecodeWidth;
+         View.ToneStride=CarrierSepar; }
+
+	   return 0; }
+
 } ;
 
 // =====================================================================
@@ -1134,14 +1572,13 @@ class MFSK_Encoder
    void PrintOutputBlock(void)
      { size_t TimeBit;
        for(TimeBit=0; TimeBit<SymbolsPerBlock; TimeBit++)
-       { printf("%2d: ",TimeBit);
+       { printf("%2d: ",(int)TimeBit);
 	     PrintBinary(OutputBlock[TimeBit],BitsPerSymbol);
 		 printf("\n"); }
      }
    
 } ;
 
-/*
 // Hard FEC decoder
 class MFSK_HardDecoder
 { public:
@@ -1301,14 +1738,14 @@ class MFSK_HardDecoder
      { size_t TimeBit;
        size_t Ptr=InputPtr;
        for(TimeBit=0; TimeBit<SymbolsPerBlock; TimeBit++)
-       { printf("%2d: ",TimeBit);
+       { printf("%2d: ",(int)TimeBit);
 	     PrintBinary(InputBuffer[Ptr],BitsPerSymbol);
 		 printf("\n");
 		 Ptr+=1; Ptr&=InputWrap; }
      }
    
 } ;
-*/
+
 // Soft FEC decoder (calls are similar to the MFSK_HardDecoder class)
 template <class InpType=float, class CalcType=float>
  class MFSK_SoftDecoder
@@ -1448,139 +1885,560 @@ template <class InpType=float, class CalcType=float>
 
 } ;
 
-// Soft but iterative (!) FEC decoder
+// Soft bits (-1.0..+1.0) can be stored as integers to save memory:
+// they are then scaled to the full range of the integer type.
+
+inline float SoftBitScale(float) { return 1.0; }
+inline float SoftBitScale(double) { return 1.0; }
+inline float SoftBitScale(int16_t) { return 32767.0; }
+inline float SoftBitScale(int8_t) { return 127.0; }
+
 template <class Type>
- class MFSK_SoftIterDecoder
+ inline void SoftBitStore(float &Bit, Type Value) { Bit=Value; }
+template <class Type>
+ inline void SoftBitStore(double &Bit, Type Value) { Bit=Value; }
+template <class Type>
+ inline void SoftBitStore(int16_t &Bit, Type Value)
+{ Value*=32767; Bit=(int16_t)(Value<0 ? Value-(Type)0.5:Value+(Type)0.5); }
+template <class Type>
+ inline void SoftBitStore(int8_t &Bit, Type Value)
+{ Value*=127; Bit=(int8_t)(Value<0 ? Value-(Type)0.5:Value+(Type)0.5); }
+
+// A bank of soft FEC decoders (like MFSK_SoftDecoder) for a set of frequency offsets:
+// all the data is stored in one array with the offsets (lanes) as the innermost index,
+// so the demodulation, the FHT and the peak search go in parallel along the lanes.
+// Lanes can be processed in parts (for example by different threads),
+// but NextSlice() must be called once after every slice has been input and decoded.
+template <class InpType=float, class CalcType=float, class FHTType=CalcType>
+ class MFSK_SoftDecoderBank
 { public:
 
-   MFSK_Parameters<Type> *Parameters;
+   MFSK_Parameters<CalcType> *Parameters;
 
-   Type *Input;				// demodulated spectra energies / tone probabilities
+   size_t Lanes;            // number of decoders (frequency offsets)
 
   private:
 
    size_t BitsPerSymbol;
-   size_t BitsPerCharacter;
-   size_t Symbols;
    size_t SymbolsPerBlock;
+   size_t SpectraPerSymbol;
 
-   Type *InputExtrinsic;	// extrinsic input information fed back from the decoder
-   Type *FHT_Codeword;		// FHT codewords to be decoded by FHT
-
-  public:
+   size_t InputBufferLen;   // [rows]
+   size_t InputPtr;         // [rows]
 
-   Type Input_SignalEnergy;
-   Type Input_NoiseEnergy;
-   Type FEC_SignalEnergy;
-   Type FEC_NoiseEnergy;
+   CalcType *Storage;       // the single allocation for all the arrays below
+   InpType *InputBuffer;    // [InputBufferLen][Lanes] soft bits, integers are scaled by SoftBitScale()
+   FHTType *FHT_Buffer;     // [SymbolsPerBlock][Lanes]
+   CalcType *SoftBits;      // [BitsPerSymbol][Lanes] soft bits of the current slice before they are stored
+   CalcType *Peak;          // [Lanes] peak of the FHT
+   CalcType *SqrSum;        // [Lanes] energy of the FHT
+   CalcType *TotalEnergy;   // [Lanes] total energy of the symbol for the soft demodulation
 
-   uint8_t *OutputBlock;
+  public:
+   CalcType *Signal;        // [Lanes] FEC signal and noise per decoder
+   CalcType *NoiseEnergy;
 
   public:
 
-   MFSK_SoftIterDecoder()
+   MFSK_SoftDecoderBank()
      { Init(); }
 
-   ~MFSK_SoftIterDecoder()
+   ~MFSK_SoftDecoderBank()
      { Free(); }
 
    void Init(void)
-     { Input=0;
-	   InputExtrinsic=0;
-       FHT_Codeword=0;
-       OutputBlock=0; }
+     { Storage=0; }
 
    void Free(void)
-     { free(Input); Input=0;
-       free(InputExtrinsic); InputExtrinsic=0;
-       free(FHT_Codeword); FHT_Codeword=0;
-       free(OutputBlock); OutputBlock=0; }
+     { free(Storage); Storage=0; }
 
-   int Preset(MFSK_Parameters<Type> *NewParameters)
+   void Reset(void)
+     { ClearArray(InputBuffer,InputBufferLen*Lanes);
+       InputPtr=0; }
+
+   // save (Load=0) or load (Load=1) the input buffer, the bank must be preset the same
+   int StateIO(FILE *File, int Load)
+     { if(StateArray(File,Load,&InputPtr,1)<0) return -1;
+       if(InputPtr>=InputBufferLen) { InputPtr=0; return -1; }
+       return StateArray(File,Load,InputBuffer,InputBufferLen*Lanes); }
+
+   int Preset(MFSK_Parameters<CalcType> *NewParameters)
      { Parameters=NewParameters;
-       BitsPerSymbol=Parameters->BitsPerSymbol;
-       BitsPerCharacter=Parameters->BitsPerCharacter;
-	   Symbols = Parameters->Carriers;
-       SymbolsPerBlock = Parameters->SymbolsPerBlock;
-       if(ReallocArray(&Input,SymbolsPerBlock*Symbols)<0) goto Error;
-       if(ReallocArray(&InputExtrinsic,SymbolsPerBlock*Symbols)<0) goto Error;
-       if(ReallocArray(&FHT_Codeword,SymbolsPerBlock*BitsPerSymbol)<0) goto Error;
-       if(ReallocArray(&OutputBlock,BitsPerSymbol)<0) goto Error;
 
-       return 0;
-       Error: Free(); return -1; }
+	   BitsPerSymbol=Parameters->BitsPerSymbol;
+	   SymbolsPerBlock=Parameters->SymbolsPerBlock;
+	   SpectraPerSymbol=Parameters->SpectraPerSymbol;
+	   InputBufferLen=SymbolsPerBlock*SpectraPerSymbol*BitsPerSymbol;
 
-   void SimulateInput(uint8_t *InputBlock, Type SNR=1.0, Type DeadCarrierSNR=0.0)
-     { Type NoiseRMS=1.0;
-	   Type Signal=SNR*NoiseRMS*sqrt(2.0*Symbols);
-       Type DeadCarrier=DeadCarrierSNR*NoiseRMS*sqrt(2.0*Symbols);
-	   size_t DeadCarrierFreq=rand()&(Symbols-1);
+       size_t InputSize=(InputBufferLen*Lanes*sizeof(InpType)+sizeof(CalcType)-1)/sizeof(CalcType);
+       size_t FHT_Size=(SymbolsPerBlock*Lanes*sizeof(FHTType)+sizeof(CalcType)-1)/sizeof(CalcType);
+       if(ReallocArray(&Storage,InputSize+FHT_Size+(BitsPerSymbol+5)*Lanes)<0) return -1;
+       InputBuffer = (InpType *)Storage;
+       FHT_Buffer  = (FHTType *)(Storage+InputSize);
+       SoftBits    = Storage+InputSize+FHT_Size;
+       Peak        = SoftBits+BitsPerSymbol*Lanes;
+       SqrSum      = Peak+Lanes;
+       TotalEnergy = SqrSum+Lanes;
+       Signal      = TotalEnergy+Lanes;
+       NoiseEnergy = Signal+Lanes;
+       Reset();
 
-	   size_t Symbol;
-       size_t Idx;
-       for(Symbol=0,Idx=0; Symbol<SymbolsPerBlock; Symbol++,Idx+=Symbols)
-       { size_t Freq;
-	     size_t SymbolFreq=InputBlock[Symbol];
-         if(Parameters->UseGrayCode) SymbolFreq=GrayCode(SymbolFreq);
-         for(Freq=0; Freq<Symbols; Freq++)
-         { Cmpx<Type> Noise;
-		   WhiteNoise(Noise,NoiseRMS);
-		   if(Freq==SymbolFreq) Noise.Re+=Signal;
-           if(Freq==DeadCarrierFreq) Noise.Im+=DeadCarrier;
-           Type Energy=Noise.Mag2();
-		   Input[Idx+Freq]=Energy*Energy;
-		 }
+       return 0; }
+
+   // soft-demodulate one spectral slice for the lanes [Start..Stop):
+   // lane number Lane takes the spectra from SpectraEnergy+Lane on
+   template <class EnergyType>
+    void SpectralInput(EnergyType *SpectraEnergy, size_t Start, size_t Stop)
+     { size_t Bit,Idx,Lane;
+       CalcType *Symbol=SoftBits;
+       for(Bit=0; Bit<BitsPerSymbol; Bit++)
+         for(Lane=Start; Lane<Stop; Lane++)
+           Symbol[Bit*Lanes+Lane]=0;
+       for(Lane=Start; Lane<Stop; Lane++)
+         TotalEnergy[Lane]=0;
+
+       int UseGrayCode=Parameters->UseGrayCode;
+       int SquareEnergy=Parameters->RxSyncSquareEnergy;
+       size_t Carriers=Exp2(BitsPerSymbol);
+       EnergyType *Energy=SpectraEnergy;
+       for(Idx=0; Idx<Carriers; Idx++, Energy+=Parameters->CarrierSepar)
+       { uint8_t SymbIdx=Idx;
+         if(UseGrayCode) SymbIdx=BinaryCode(SymbIdx);
+         for(Lane=Start; Lane<Stop; Lane++)
+         { CalcType LaneEnergy=Energy[Lane];
+           if(SquareEnergy) LaneEnergy*=LaneEnergy;
+           TotalEnergy[Lane]+=LaneEnergy; }
+         uint8_t Mask=1;
+         for(Bit=0; Bit<BitsPerSymbol; Bit++, Mask<<=1)
+         { CalcType *BitRow=Symbol+Bit*Lanes;
+           if(SymbIdx&Mask)
+           { for(Lane=Start; Lane<Stop; Lane++)
+             { CalcType LaneEnergy=Energy[Lane];
+               if(SquareEnergy) LaneEnergy*=LaneEnergy;
+               BitRow[Lane]-=LaneEnergy; }
+           }
+           else
+           { for(Lane=Start; Lane<Stop; Lane++)
+             { CalcType LaneEnergy=Energy[Lane];
+               if(SquareEnergy) LaneEnergy*=LaneEnergy;
+               BitRow[Lane]+=LaneEnergy; }
+           }
+         }
        }
 
-	 }
+       InpType *Stored=InputBuffer+InputPtr*Lanes;  // integer stores may alias anything: use local variables
+       CalcType *Total=TotalEnergy;
+       for(Bit=0; Bit<BitsPerSymbol; Bit++)
+       { CalcType *BitRow=Symbol+Bit*Lanes;
+         InpType *StoredRow=Stored+Bit*Lanes;
+         for(Lane=Start; Lane<Stop; Lane++)
+         { CalcType Value=BitRow[Lane];
+           if(Total[Lane]>0) Value/=Total[Lane];
+           SoftBitStore(StoredRow[Lane],Value); }
+       }
+     }
 
-   int NormalizeSum(Type *Data, size_t Len, Type Norm=1.0)
-     { size_t Idx;
-	   Type Sum=0;
-	   for(Idx=0; Idx<Len; Idx++)
-	     Sum+=Data[Idx];
-	   if(Sum<=0) return -1;
-	   Type Corr=Norm/Sum;
-	   for(Idx=0; Idx<Len; Idx++)
-	     Data[Idx]*=Corr;
-	   return 0; }
+   // move on to the next slice
+   void NextSlice(void)
+     { InputPtr+=BitsPerSymbol;
+       if(InputPtr>=InputBufferLen) InputPtr-=InputBufferLen; }
 
-   int NormalizeAbsSum(Type *Data, size_t Len, Type Norm=1.0)
-     { size_t Idx;
-	   Type Sum=0;
-	   for(Idx=0; Idx<Len; Idx++)
-	     Sum+=fabs(Data[Idx]);
-	   if(Sum<=0) return -1;
-	   Type Corr=Norm/Sum;
-	   for(Idx=0; Idx<Len; Idx++)
-	     Data[Idx]*=Corr;
-	   return 0; }
+   void DecodeCharacter(size_t FreqBit, size_t Start, size_t Stop)
+     { size_t TimeBit,Lane;
 
-   int ThirdPower(Type *Data, size_t Len)
-     { size_t Idx;
-	   for(Idx=0; Idx<Len; Idx++)
-	   { Type Square=Data[Idx];
-	     // Square=Square*Square;
-		 Square=fabs(Square);		// <= works better (in simulations)
-		 Data[Idx]*=Square; }
-	   return 0; }
-/*
-   void CalculateSymbolBitProb(Type *SymbolBit, Type *FreqProb)
-     { size_t Bit;
-	   for(Bit=0; Bit<BitsPerSymbol; Bit++)
-	     SymbolBit[Bit]=0;
-	   size_t Freq;
-	   for(Freq=0; Freq<Symbols; Freq++)
-	   { Type Prob=FreqProb[Freq];
-	     uint8_t Symbol=Freq;
-	     if(Parameters->UseGrayCode) Symbol=BinaryCode(Symbol);
-         uint8_t Mask=1;
-         for(Bit=0; Bit<BitsPerSymbol; Bit++)
-		 { if(Symbol&Mask) SymbolBit[Bit]-=Prob;
-		              else SymbolBit[Bit]+=Prob;
-		   Mask<<=1; }
-	   }
-	 }
+       size_t Ptr=InputPtr+BitsPerSymbol;   // the oldest slice in the buffer
+       if(Ptr>=InputBufferLen) Ptr-=InputBufferLen;
+       size_t Rotate=FreqBit;
+       size_t CodeWrap=(SymbolsPerBlock-1);
+       size_t CodeBit=FreqBit*13; CodeBit&=CodeWrap;
+       for(TimeBit=0; TimeBit<SymbolsPerBlock; TimeBit++)
+       { InpType *Bit=InputBuffer+(Ptr+Rotate)*Lanes;
+         FHTType *FHT_Row=FHT_Buffer+TimeBit*Lanes;
+         uint64_t CodeMask=1; CodeMask<<=CodeBit;
+         if(Parameters->ScramblingCode&CodeMask)
+         { for(Lane=Start; Lane<Stop; Lane++)
+             FHT_Row[Lane]=(-Bit[Lane]); }
+         else
+         { for(Lane=Start; Lane<Stop; Lane++)
+             FHT_Row[Lane]=Bit[Lane]; }
+         CodeBit+=1; CodeBit&=CodeWrap;
+         Rotate+=1; if(Rotate>=BitsPerSymbol) Rotate-=BitsPerSymbol;
+         Ptr+=(BitsPerSymbol*SpectraPerSymbol);
+         if(Ptr>=InputBufferLen) Ptr-=InputBufferLen; }
+
+       FHT(FHT_Buffer,SymbolsPerBlock,Lanes,Start,Stop);
+
+       for(Lane=Start; Lane<Stop; Lane++)
+       { Peak[Lane]=0; SqrSum[Lane]=0; }
+       for(TimeBit=0; TimeBit<SymbolsPerBlock; TimeBit++)
+       { FHTType *FHT_Row=FHT_Buffer+TimeBit*Lanes;
+         for(Lane=Start; Lane<Stop; Lane++)
+         { CalcType Signal=FHT_Row[Lane];
+           SqrSum[Lane]+=Signal*Signal;
+           if(fabs(Signal)>fabs(Peak[Lane])) Peak[Lane]=Signal; }
+       }
+
+       for(Lane=Start; Lane<Stop; Lane++)
+       { CalcType LanePeak=Peak[Lane];
+         NoiseEnergy[Lane]+=(SqrSum[Lane]-LanePeak*LanePeak)/(SymbolsPerBlock-1);
+         Signal[Lane]+=fabs(LanePeak); }
+     }
+
+   // decode the block which ends with the current slice, for the lanes [Start..Stop)
+   void Process(size_t Start, size_t Stop)
+     { size_t FreqBit,Lane;
+       for(Lane=Start; Lane<Stop; Lane++)
+       { Signal[Lane]=0; NoiseEnergy[Lane]=0; }
+       for(FreqBit=0; FreqBit<BitsPerSymbol; FreqBit++)
+         DecodeCharacter(FreqBit,Start,Stop);
+       for(Lane=Start; Lane<Stop; Lane++)
+       { Signal[Lane]/=BitsPerSymbol;
+         NoiseEnergy[Lane]/=BitsPerSymbol; }
+       CalcType Scale=SoftBitScale((InpType)0);
+       if(Scale!=1)                         // back to the units of the float soft bits
+       { CalcType InvScale=1.0/Scale;
+         for(Lane=Start; Lane<Stop; Lane++)
+         { Signal[Lane]*=InvScale;
+           NoiseEnergy[Lane]*=InvScale*InvScale; }
+       }
+     }
+
+} ;
+
+// A bank of hard decoders (like MFSK_HardDecoder) for the lanes of MFSK_SoftDecoderBank:
+// every lane takes the strongest tone as the symbol and the FHT runs on int8_t,
+// thus it is much cheaper, but less sensitive than the soft decoding.
+// All characters of a block are decoded by one FHT: every lane is widened
+// to 8 sub-lanes, one per character (bit of the symbol).
+
+template <class CalcType=float>
+ class MFSK_HardDecoderBank
+{ public:
+
+   MFSK_Parameters<CalcType> *Parameters;
+
+   size_t Lanes;            // number of decoders (frequency offsets)
+
+  private:
+
+   static const size_t SubLanes = 8; // [characters per lane] at most 8 bits per symbol
+
+   size_t BitsPerSymbol;
+   size_t SymbolsPerBlock;
+   size_t SpectraPerSymbol;
+
+   size_t InputBufferLen;   // [rows]
+   size_t InputPtr;         // [rows]
+
+   uint8_t *InputBuffer;    // [InputBufferLen][Lanes] hard symbols
+   int8_t *FHT_Buffer;      // [SymbolsPerBlock][Lanes][SubLanes]
+   int8_t *Peak;            // [Lanes][SubLanes] peak of the FHT
+   uint64_t *Expand;        // [256] a byte of bits expanded into SubLanes of +/-1
+   uint8_t *CodeByte;       // [SymbolsPerBlock] scrambling code bits for all characters
+   CalcType *MaxEnergy;     // [Lanes] energy of the strongest tone so far
+
+  public:
+   CalcType *Signal;        // [Lanes] FEC signal and noise per decoder
+   CalcType *NoiseEnergy;
+
+  public:
+
+   MFSK_HardDecoderBank()
+     { Init(); }
+
+   ~MFSK_HardDecoderBank()
+     { Free(); }
+
+   void Init(void)
+     { InputBuffer=0;
+       FHT_Buffer=0;
+       Peak=0;
+       Expand=0;
+       CodeByte=0;
+       MaxEnergy=0; }
+
+   void Free(void)
+     { free(InputBuffer); InputBuffer=0;
+       free(FHT_Buffer); FHT_Buffer=0;
+       free(Peak); Peak=0;
+       free(Expand); Expand=0;
+       free(CodeByte); CodeByte=0;
+       free(MaxEnergy); MaxEnergy=0; }
+
+   void Reset(void)
+     { ClearArray(InputBuffer,InputBufferLen*Lanes);
+       InputPtr=0; }
+
+   // save (Load=0) or load (Load=1) the input buffer, the bank must be preset the same
+   int StateIO(FILE *File, int Load)
+     { if(StateArray(File,Load,&InputPtr,1)<0) return -1;
+       if(InputPtr>=InputBufferLen) { InputPtr=0; return -1; }
+       return StateArray(File,Load,InputBuffer,InputBufferLen*Lanes); }
+
+   int Preset(MFSK_Parameters<CalcType> *NewParameters)
+     { Parameters=NewParameters;
+
+	   BitsPerSymbol=Parameters->BitsPerSymbol;
+	   SymbolsPerBlock=Parameters->SymbolsPerBlock;
+	   SpectraPerSymbol=Parameters->SpectraPerSymbol;
+	   InputBufferLen=SymbolsPerBlock*SpectraPerSymbol;
+
+       if(ReallocArray(&InputBuffer,InputBufferLen*Lanes)<0) goto Error;
+       if(ReallocArray(&FHT_Buffer,SymbolsPerBlock*Lanes*SubLanes)<0) goto Error;
+       if(ReallocArray(&Peak,Lanes*SubLanes)<0) goto Error;
+       if(ReallocArray(&MaxEnergy,3*Lanes)<0) goto Error;
+       Signal      = MaxEnergy+Lanes;
+       NoiseEnergy = Signal+Lanes;
+
+       if(ReallocArray(&Expand,256)<0) goto Error;
+       { size_t Byte,Bit;
+         for(Byte=0; Byte<256; Byte++)
+         { int8_t Value[SubLanes];
+           for(Bit=0; Bit<SubLanes; Bit++)
+             Value[Bit] = (Byte>>Bit)&1 ? -1:1;
+           memcpy(Expand+Byte,Value,SubLanes); }
+       }
+
+       if(ReallocArray(&CodeByte,SymbolsPerBlock)<0) goto Error;
+       { size_t TimeBit,FreqBit;
+         size_t CodeWrap=(SymbolsPerBlock-1);
+         for(TimeBit=0; TimeBit<SymbolsPerBlock; TimeBit++)
+         { uint8_t Code=0;
+           for(FreqBit=0; FreqBit<BitsPerSymbol; FreqBit++)
+           { size_t CodeBit=(FreqBit*13+TimeBit)&CodeWrap;
+             if((Parameters->ScramblingCode>>CodeBit)&1) Code|=(1<<FreqBit); }
+           CodeByte[TimeBit]=Code; }
+       }
+
+       Reset();
+
+       return 0;
+
+       Error: Free(); return -1; }
+
+   // hard-demodulate one spectral slice for the lanes [Start..Stop):
+   // lane number Lane takes the spectra from SpectraEnergy+Lane on
+   template <class InpType>
+    void SpectralInput(InpType *SpectraEnergy, size_t Start, size_t Stop)
+     { size_t Idx,Lane;
+       uint8_t *Symbol=InputBuffer+InputPtr*Lanes; // uint8_t stores may alias anything: keep all in local variables
+       CalcType *Max=MaxEnergy;
+       for(Lane=Start; Lane<Stop; Lane++)
+       { Max[Lane]=(-1); Symbol[Lane]=0; }
+
+       int UseGrayCode=Parameters->UseGrayCode;
+       size_t Carriers=Exp2(BitsPerSymbol);
+       size_t CarrierSepar=Parameters->CarrierSepar;
+       InpType *Energy=SpectraEnergy;
+       for(Idx=0; Idx<Carriers; Idx++, Energy+=CarrierSepar)
+       { uint8_t SymbIdx=Idx;
+         if(UseGrayCode) SymbIdx=BinaryCode(SymbIdx);
+         for(Lane=Start; Lane<Stop; Lane++)
+         { CalcType LaneEnergy=Energy[Lane];
+           int Larger = LaneEnergy>Max[Lane];
+           Symbol[Lane] = Larger ? SymbIdx:Symbol[Lane];
+           Max[Lane]    = Larger ? LaneEnergy:Max[Lane]; }
+       }
+     }
+
+   // move on to the next slice
+   void NextSlice(void)
+     { InputPtr+=1;
+       if(InputPtr>=InputBufferLen) InputPtr-=InputBufferLen; }
+
+   // decode the block which ends with the current slice, for the lanes [Start..Stop)
+   void Process(size_t Start, size_t Stop)
+     { size_t TimeBit,Lane,Idx;
+
+       size_t Bits=BitsPerSymbol;           // int8_t stores may alias anything: keep all in local variables
+       size_t Len=SymbolsPerBlock;
+       size_t Width=Lanes*SubLanes;
+       uint64_t *ExpandBits=Expand;
+       int8_t *Buffer=FHT_Buffer;
+       int8_t *BufferPeak=Peak;
+
+       size_t Ptr=InputPtr+1;               // the oldest slice in the buffer
+       if(Ptr>=InputBufferLen) Ptr-=InputBufferLen;
+       size_t Rotate=0;                     // character FreqBit takes bit (FreqBit+TimeBit)%BitsPerSymbol
+       unsigned int SymbolMask=Exp2(Bits)-1;
+       for(TimeBit=0; TimeBit<Len; TimeBit++)
+       { uint8_t *Symbol=InputBuffer+Ptr*Lanes;
+         uint64_t *FHT_Row=(uint64_t *)(Buffer+TimeBit*Width);
+         unsigned int Code=CodeByte[TimeBit];
+         for(Lane=Start; Lane<Stop; Lane++)
+         { unsigned int Sym=Symbol[Lane];
+           unsigned int SymBits=((Sym>>Rotate)|(Sym<<(Bits-Rotate)))&SymbolMask;
+           FHT_Row[Lane]=ExpandBits[SymBits^Code]; }
+         Rotate+=1; if(Rotate>=Bits) Rotate=0;
+         Ptr+=SpectraPerSymbol;
+         if(Ptr>=InputBufferLen) Ptr-=InputBufferLen; }
+
+       size_t WideStart=Start*SubLanes, WideStop=Stop*SubLanes;
+       FHT(Buffer,Len,Width,WideStart,WideStop);   // |values| <= SymbolsPerBlock fit into int8_t
+
+       for(Idx=WideStart; Idx<WideStop; Idx++)
+         BufferPeak[Idx]=0;
+       for(TimeBit=0; TimeBit<Len; TimeBit++)
+       { int8_t *FHT_Row=Buffer+TimeBit*Width;
+         for(Idx=WideStart; Idx<WideStop; Idx++)
+         { int8_t Signal = FHT_Row[Idx]<0 ? -FHT_Row[Idx]:FHT_Row[Idx];
+           BufferPeak[Idx] = Signal>BufferPeak[Idx] ? Signal:BufferPeak[Idx]; }
+       }
+
+       int32_t SqrSum=Len*Len;              // FHT of +/-1 always has the same energy
+       for(Lane=Start; Lane<Stop; Lane++)
+       { int32_t LaneSignal=0;
+         CalcType LaneNoise=0;
+         size_t FreqBit;
+         for(FreqBit=0; FreqBit<BitsPerSymbol; FreqBit++)
+         { int32_t LanePeak=BufferPeak[Lane*SubLanes+FreqBit];
+           LaneNoise+=(CalcType)(SqrSum-LanePeak*LanePeak)/(SymbolsPerBlock-1);
+           LaneSignal+=LanePeak; }
+         Signal[Lane]=(CalcType)LaneSignal/BitsPerSymbol;
+         NoiseEnergy[Lane]=LaneNoise/BitsPerSymbol; }
+     }
+
+} ;
+
+// Soft but iterative (!) FEC decoder
+template <class Type>
+ class MFSK_SoftIterDecoder
+{ public:
+
+   MFSK_Parameters<Type> *Parameters;
+
+   Type *Input;				// demodulated spectra energies / tone probabilities
+   MFSK_SpectraView<Type> InputView; // where Process() takes the energies from: Input or the demodulator history
+
+  private:
+
+   size_t BitsPerSymbol;
+   size_t BitsPerCharacter;
+   size_t Symbols;
+   size_t SymbolsPerBlock;
+
+   Type *InputExtrinsic;	// extrinsic input information fed back from the decoder
+   Type *FHT_Codeword;		// FHT codewords to be decoded by FHT
+
+  public:
+
+   Type Input_SignalEnergy;
+   Type Input_NoiseEnergy;
+   Type FEC_SignalEnergy;
+   Type FEC_NoiseEnergy;
+
+   uint8_t *OutputBlock;
+
+  public:
+
+   MFSK_SoftIterDecoder()
+     { Init(); }
+
+   ~MFSK_SoftIterDecoder()
+     { Free(); }
+
+   void Init(void)
+     { Input=0;
+	   InputExtrinsic=0;
+       FHT_Codeword=0;
+       OutputBlock=0; }
+
+   void Free(void)
+     { free(Input); Input=0;
+       free(InputExtrinsic); InputExtrinsic=0;
+       free(FHT_Codeword); FHT_Codeword=0;
+       free(OutputBlock); OutputBlock=0; }
+
+   int Preset(MFSK_Parameters<Type> *NewParameters)
+     { Parameters=NewParameters;
+       BitsPerSymbol=Parameters->BitsPerSymbol;
+       BitsPerCharacter=Parameters->BitsPerCharacter;
+	   Symbols = Parameters->Carriers;
+       SymbolsPerBlock = Parameters->SymbolsPerBlock;
+       if(ReallocArray(&Input,SymbolsPerBlock*Symbols)<0) goto Error;
+       if(ReallocArray(&InputExtrinsic,SymbolsPerBlock*Symbols)<0) goto Error;
+       if(ReallocArray(&FHT_Codeword,SymbolsPerBlock*BitsPerSymbol)<0) goto Error;
+       if(ReallocArray(&OutputBlock,BitsPerSymbol)<0) goto Error;
+       UseInput();
+
+       return 0;
+       Error: Free(); return -1; }
+
+   // take the energies from the Input array
+   void UseInput(void)
+     { InputView.Set(Input,SymbolsPerBlock,Symbols); }
+
+   void SimulateInput(uint8_t *InputBlock, Type SNR=1.0, Type DeadCarrierSNR=0.0)
+     { Type NoiseRMS=1.0;
+	   Type Signal=SNR*NoiseRMS*sqrt(2.0*Symbols);
+       Type DeadCarrier=DeadCarrierSNR*NoiseRMS*sqrt(2.0*Symbols);
+	   size_t DeadCarrierFreq=rand()&(Symbols-1);
+
+	   size_t Symbol;
+       size_t Idx;
+       for(Symbol=0,Idx=0; Symbol<SymbolsPerBlock; Symbol++,Idx+=Symbols)
+       { size_t Freq;
+	     size_t SymbolFreq=InputBlock[Symbol];
+         if(Parameters->UseGrayCode) SymbolFreq=GrayCode(SymbolFreq);
+         for(Freq=0; Freq<Symbols; Freq++)
+         { Cmpx<Type> Noise;
+		   WhiteNoise(Noise,NoiseRMS);
+		   if(Freq==SymbolFreq) Noise.Re+=Signal;
+           if(Freq==DeadCarrierFreq) Noise.Im+=DeadCarrier;
+           Type Energy=Noise.Mag2();
+		   Input[Idx+Freq]=Energy*Energy;
+		 }
+       }
+
+	 }
+
+   int NormalizeSum(Type *Data, size_t Len, Type Norm=1.0)
+     { size_t Idx;
+	   Type Sum=0;
+	   for(Idx=0; Idx<Len; Idx++)
+	     Sum+=Data[Idx];
+	   if(Sum<=0) return -1;
+	   Type Corr=Norm/Sum;
+	   for(Idx=0; Idx<Len; Idx++)
+	     Data[Idx]*=Corr;
+	   return 0; }
+
+   int NormalizeAbsSum(Type *Data, size_t Len, Type Norm=1.0)
+     { size_t Idx;
+	   Type Sum=0;
+	   for(Idx=0; Idx<Len; Idx++)
+	     Sum+=fabs(Data[Idx]);
+	   if(Sum<=0) return -1;
+	   Type Corr=Norm/Sum;
+	   for(Idx=0; Idx<Len; Idx++)
+	     Data[Idx]*=Corr;
+	   return 0; }
+
+   int ThirdPower(Type *Data, size_t Len)
+     { size_t Idx;
+	   for(Idx=0; Idx<Len; Idx++)
+	   { Type Square=Data[Idx];
+	     // Square=Square*Square;
+		 Square=fabs(Square);		// <= works better (in simulations)
+		 Data[Idx]*=Square; }
+	   return 0; }
+/*
+   void CalculateSymbolBitProb(Type *SymbolBit, Type *FreqProb)
+     { size_t Bit;
+	   for(Bit=0; Bit<BitsPerSymbol; Bit++)
+	     SymbolBit[Bit]=0;
+	   size_t Freq;
+	   for(Freq=0; Freq<Symbols; Freq++)
+	   { Type Prob=FreqProb[Freq];
+	     uint8_t Symbol=Freq;
+	     if(Parameters->UseGrayCode) Symbol=BinaryCode(Symbol);
+         uint8_t Mask=1;
+         for(Bit=0; Bit<BitsPerSymbol; Bit++)
+		 { if(Symbol&Mask) SymbolBit[Bit]-=Prob;
+		              else SymbolBit[Bit]+=Prob;
+		   Mask<<=1; }
+	   }
+	 }
 
    void CalculateFreqProb( Type *FreqProb, Type *SymbolBit)
      { size_t Freq;
@@ -1671,10 +2529,15 @@ template <class Type>
      {
 
        int SquareEnergy=Parameters->DecodeSquareEnergy;
-       for(InpIdx=0; InpIdx<InputSize; InpIdx++)
-	   { Type InputEnergy=Input[InpIdx];
-         if(SquareEnergy) InputEnergy*=InputEnergy;
-	     InputExtrinsic[InpIdx]*=InputEnergy;
+       size_t ToneStride=InputView.ToneStride;
+       for(TimeBit=0,InpIdx=0; TimeBit<SymbolsPerBlock; TimeBit++,InpIdx+=Symbols)
+       { Type *Energy=InputView.SymbolPtr(TimeBit);
+         Type *Extrinsic=InputExtrinsic+InpIdx;
+         for(Freq=0; Freq<Symbols; Freq++)
+	     { Type InputEnergy=Energy[Freq*ToneStride];
+           if(SquareEnergy) InputEnergy*=InputEnergy;
+	       Extrinsic[Freq]*=InputEnergy;
+	     }
 	   }
 
 	   Type SymbolBit[BitsPerSymbol];
@@ -1759,8 +2622,9 @@ template <class Type>
        Input_SignalEnergy=0;
        Input_NoiseEnergy=0;
        for(TimeBit=0,InpIdx=0; TimeBit<SymbolsPerBlock; TimeBit++)
-       { for(Freq=0; Freq<Symbols; Freq++,InpIdx++)
-	     { Type Energy=Input[InpIdx];
+       { Type *SymbolEnergy=InputView.SymbolPtr(TimeBit);
+         for(Freq=0; Freq<Symbols; Freq++,InpIdx++)
+	     { Type Energy=SymbolEnergy[Freq*InputView.ToneStride];
 		   Type SigProb=InputExtrinsic[InpIdx];
            Input_SignalEnergy+=SigProb*Energy;
 		   Input_NoiseEnergy+=(1-SigProb)*Energy;
@@ -1790,14 +2654,8 @@ template <class Type>
 
 	 }
 
-   int WriteOutputBlock(FIFO<uint8_t> &Output)
-     { size_t Bit; int Written;
-       for(Written=0, Bit=0; Bit<BitsPerSymbol; Bit++)
-       { uint8_t Char=OutputBlock[Bit];
-	     int Error=Output.Write(Char);
-		 if(Error<0) break;
-		 Written+=Error; }
-	   return Written; }
+   int WriteOutputBlock(LockFreeFIFO<uint8_t> &Output)
+     { return Output.Write(OutputBlock,BitsPerSymbol); }
 
 /*
    void PrintOutputBlock(FILE *File=stdout)
@@ -1834,9 +2692,9 @@ template <class Type=float>
    static const int State_StopReq = 0x0010;
    int State;
 
-   FIFO<uint8_t> Input;     // buffer(queue) for the characters to be encoded
-   uint8_t InputBlock[8];   // FEC code block buffer
-   FIFO<uint8_t> Monitor;   // buffer for monitoring the characters being sent
+   LockFreeFIFO<uint8_t> Input;   // buffer(queue) for the characters to be encoded
+   uint8_t InputBlock[8];         // FEC code block buffer
+   LockFreeFIFO<uint8_t> Monitor; // buffer for monitoring the characters being sent
 
    MFSK_Encoder Encoder;    // FEC encoder
    size_t SymbolPtr;
@@ -1844,7 +2702,7 @@ template <class Type=float>
    MFSK_Modulator<Type> Modulator; // MFSK modulator
 
    Type *ModulatorOutput;             // modulator output
-   RateConverter<Type> RateConverter; // output rate converter
+   RateConverter<Type> OutputRateConverter; // output rate converter
    Type *ConverterOutput;             // rate converter output
 
   public:
@@ -1865,7 +2723,7 @@ template <class Type=float>
        Encoder.Free();
        Modulator.Free();
        free(ModulatorOutput); ModulatorOutput=0;
-	   RateConverter.Free();
+	   OutputRateConverter.Free();
        free(ConverterOutput); ConverterOutput=0; }
 
    // preset internal arrays according to primary paramaters
@@ -1893,8 +2751,8 @@ template <class Type=float>
        if(ReallocArray(&ModulatorOutput,Modulator.OutputLen)<0) goto Error;
 
        // preset the rate converter
-       RateConverter.OutputRate=Parameters->OutputSampleRate/Parameters->SampleRate;
-	   if(RateConverter.Preset()<0) goto Error;
+       OutputRateConverter.OutputRate=Parameters->OutputSampleRate/Parameters->SampleRate;
+	   if(OutputRateConverter.Preset()<0) goto Error;
 
        MaxOutputLen=(size_t)ceil(Parameters->SymbolSepar*Parameters->OutputSampleRate/Parameters->SampleRate+2);
        if(ReallocArray(&ConverterOutput,MaxOutputLen)<0) goto Error;
@@ -1910,7 +2768,7 @@ template <class Type=float>
 	   Monitor.Reset();
        SymbolPtr=0;
        State=0;
-	   RateConverter.Reset(); }
+	   OutputRateConverter.Reset(); }
 
    // start the transmission
    void Start(void)
@@ -1929,10 +2787,18 @@ template <class Type=float>
    int PutChar(uint8_t Char)
      { return Input.Write(Char); }
 
+   // put up to Len characters, return how many were taken
+   size_t PutChars(uint8_t *Chars, size_t Len)
+     { return Input.Write(Chars,Len); }
+
    // get one character from the monitor buffer
    int GetChar(uint8_t &Char)
      { return Monitor.Read(Char); }
 
+   // get up to MaxLen characters from the monitor buffer, return how many
+   size_t GetChars(uint8_t *Chars, size_t MaxLen)
+     { return Monitor.Read(Chars,MaxLen); }
+
    // get out the transmitter output (audio)
    int Output(Type *&OutputPtr)
      { if(SymbolPtr==0)                            // when at the block boundary
@@ -1940,11 +2806,8 @@ template <class Type=float>
          { State=0; }                              // then simply stop
          else if(State&State_Running)             // otherwise when state is "running" then keep going
 	     { size_t Idx;                             // form a new block
-	       for(Idx=0; Idx<BitsPerSymbol; Idx++)   // loop over characters in a block
-		   { uint8_t Char;
-		     if(Input.Read(Char)<=0) break;       // get character from the input FIFO
-             InputBlock[Idx]=Char;                 // put it into the block
-			 Monitor.Write(Char); }                // put this character into the monitor FIFO
+	       Idx=Input.Read(InputBlock,BitsPerSymbol); // get the characters from the input FIFO
+           Monitor.Write(InputBlock,Idx);          // put them into the monitor FIFO
 	       for(     ; Idx<BitsPerSymbol; Idx++)    // fill the unused part of the block
              InputBlock[Idx]=0;
            Encoder.EncodeBlock(InputBlock);         // encode the new block
@@ -1954,7 +2817,7 @@ template <class Type=float>
 	   { Modulator.Send(Encoder.OutputBlock[SymbolPtr]); // send out the next symbol of encoded block through the modulator
          SymbolPtr+=1; if(SymbolPtr>=SymbolsPerBlock) SymbolPtr=0; }
        int ModLen=Modulator.Output(ModulatorOutput);     // get the modulator output
-	   int ConvLen=RateConverter.Process(ModulatorOutput,ModLen,ConverterOutput); // correct the sampling rate
+	   int ConvLen=OutputRateConverter.Process(ModulatorOutput,ModLen,ConverterOutput); // correct the sampling rate
        if(ConvLen<0) return ConvLen;
        OutputPtr=ConverterOutput;
 	   return ConvLen; }
@@ -1968,82 +2831,366 @@ template <class Type=float>
 } ;
 
 // =====================================================================
+// Coarse frequency search: ranks the possible frequency offsets over the wide
+// search margin by the tone energy alone, so the (expensive) FEC synchronizer
+// only needs to cover a narrow window around the best candidate.
+// As the input processor flattens the spectrum, the score is the contrast
+// between the power on the tone comb and the power half-way between the tones.
 
 template <class Type=float>
- class MFSK_Synchronizer
+ class MFSK_FreqSearch
 { public:
 
    MFSK_Parameters<Type> *Parameters;
 
-  public:
-
   private:
 
-   size_t FreqOffsets;                     // number of possible frequency offsets
-   size_t BlockPhases;                     // number of possible time-phases within the FEC block
-   MFSK_SoftDecoder<Type,Type> *Decoder;   // array of decoders
-  public:
-   size_t BlockPhase;                      // current running block time-phase
-  private:
-   CircularBuffer< LowPass3_Filter<Type> >  SyncNoiseEnergy; // FEC noise integrators
-   CircularBuffer< LowPass3_Filter<Type> >  SyncSignal;      // FEC signal integrators
-   Type SyncFilterWeight;                                    // weight for the integrators
+   size_t Width;                          // spectra width (as in the demodulator history) [FFT bins]
+   size_t Offsets;                        // number of candidate offsets [FFT bins]
+   Type *BinPower;                        // averaged square energy for every FFT bin
+   Type *Sorted;                          // [Width] for FloorPower()
+   Type Weight;                           // weight for the averaging
+   size_t SliceCount;                     // counts slices up to one FEC block
+   size_t PrevOffset;                     // the best offset found the FEC block before
 
   public:
 
-   Type SyncBestSignal;                   // best signal
-   size_t SyncBestBlockPhase;             // time-phase of the best signal        [FFT bins]
-   size_t SyncBestFreqOffset;             // frequency offset of the best signal  [FFT spectral slices]
-   Type SyncSNR;                          // S/N corresponding to the SyncBestSignal
-   int DecodeReference;                   // when 0 then right in the middle of a FEC block
+   // the user-settable parameters:
+   Type Threshold;                        // how far the best score must stand out of the others [RMS]
 
-   Type PreciseFreqOffset;                // precise interpolated frequency offset [FFT bins]
-   Type PreciseBlockPhase;                //                   and the FEC block phase [spectral slices]
-   size_t StableLock;                     // is 1 when the sync. looks stable
-   LowPass3_Filter<Type> FreqDrift;       // frequency drift rate [FFT bin / FEC block]
-   LowPass3_Filter<Type> TimeDrift;       // block phase (time) drift rate [ppm]
+  public:
+
+   Type *Comb;                            // tone comb power for every offset
+   Type *Score;                           // contrast: comb power minus the power between the tones
+   Type ScoreRMS;                         // noise level of the score
+   size_t BestOffset;                     // offset with the highest score [FFT bins]
+   size_t BestCount;                      // number of consecutive FEC blocks BestOffset stayed in place
 
   public:
 
-   MFSK_Synchronizer()
-     { Init(); }
+   MFSK_FreqSearch()
+     { Init();
+       Default(); }
 
-   ~MFSK_Synchronizer()
+   ~MFSK_FreqSearch()
      { Free(); }
 
    void Init(void)
-     { Decoder=0; }
+     { BinPower=0;
+       Sorted=0;
+       Comb=0;
+       Score=0; }
+
+   void Default(void)
+     { Threshold=6.0; }
 
    void Free(void)
-     { if(Decoder)
-       { size_t Idx;
-         for(Idx=0; Idx<FreqOffsets; Idx++)
-           Decoder[Idx].Free();
-         free(Decoder); Decoder=0;
-       }
-       SyncSignal.Free();
-       SyncNoiseEnergy.Free();
-     }
+     { free(BinPower); BinPower=0;
+       free(Sorted); Sorted=0;
+       free(Comb); Comb=0;
+       free(Score); Score=0; }
 
-   // resize internal arrays according the parameters
    int Preset(MFSK_Parameters<Type> *NewParameters)
      { Parameters=NewParameters;
-	 
-	   size_t Idx;
 
-       if(Decoder)
-       { for(Idx=0; Idx<FreqOffsets; Idx++)
-           Decoder[Idx].Free();
-       }
+       Offsets=2*Parameters->SearchMargin*Parameters->CarrierSepar+1;
+       Width=(Parameters->Carriers-1)*Parameters->CarrierSepar+Offsets;
 
-       FreqOffsets=2*Parameters->RxSyncMargin*Parameters->CarrierSepar+1;
-       BlockPhases=Parameters->SpectraPerSymbol*Parameters->SymbolsPerBlock;
+       if(ReallocArray(&BinPower,Width)<0) goto Error;
+       if(ReallocArray(&Sorted,Width)<0) goto Error;
+       if(ReallocArray(&Comb,Offsets)<0) goto Error;
+       if(ReallocArray(&Score,Offsets)<0) goto Error;
 
-       if(ReallocArray(&Decoder,FreqOffsets)<0) goto Error;
-       for(Idx=0; Idx<FreqOffsets; Idx++)
-         Decoder[Idx].Init();
-       for(Idx=0; Idx<FreqOffsets; Idx++)
-         if(Decoder[Idx].Preset(Parameters)<0) goto Error;
+       Weight=1.0/(Parameters->RxSyncIntegLen*Parameters->SpectraPerBlock);
+
+       Reset();
+
+       return 0;
+
+       Error: Free(); return -1; }
+
+   void Reset(void)
+     { ClearArray(BinPower,Width);
+       ClearArray(Comb,Offsets);
+       ClearArray(Score,Offsets);
+       SliceCount=0;
+       ScoreRMS=0;
+       BestOffset=Offsets/2;
+       PrevOffset=BestOffset;
+       BestCount=0; }
+
+   // save (Load=0) or load (Load=1) the averages and the ranking, the search must be preset the same
+   int StateIO(FILE *File, int Load)
+     { if(StateArray(File,Load,BinPower,Width)<0) return -1;
+       if(StateArray(File,Load,Comb,Offsets)<0) return -1;
+       if(StateArray(File,Load,Score,Offsets)<0) return -1;
+       if(StateArray(File,Load,&SliceCount,1)<0) return -1;
+       if(StateArray(File,Load,&ScoreRMS,1)<0) return -1;
+       if(StateArray(File,Load,&BestOffset,1)<0) return -1;
+       if(StateArray(File,Load,&PrevOffset,1)<0) return -1;
+       if(StateArray(File,Load,&BestCount,1)<0) return -1;
+       if((BestOffset>=Offsets)||(PrevOffset>=Offsets)) { Reset(); return -1; }
+       return 0; }
+
+   // process one spectral slice, return 1 when the ranking is updated (once per FEC block)
+   int Process(Type *Spectra)
+     { size_t Idx;
+       for(Idx=0; Idx<Width; Idx++)
+       { Type Energy=Spectra[Idx]; Energy*=Energy;
+         BinPower[Idx]+=Weight*(Energy-BinPower[Idx]); }
+
+       SliceCount+=1;
+       if(SliceCount<Parameters->SpectraPerBlock) return 0;
+       SliceCount=0;
+
+       size_t Carriers=Parameters->Carriers;
+       size_t CarrierSepar=Parameters->CarrierSepar;
+       size_t Offset;
+       for(Offset=0; Offset<Offsets; Offset++)
+       { Type Sum=0;
+         Type *Power=BinPower+Offset;
+         size_t Carrier;
+         for(Carrier=0; Carrier<Carriers; Carrier++, Power+=CarrierSepar)
+           Sum+=(*Power);
+         Comb[Offset]=Sum; }
+
+       size_t Half=CarrierSepar/2;
+       Type BestScore=0;
+       for(Offset=0; Offset<Offsets; Offset++)
+       { Type Between = (Offset+Half)<Offsets ? Comb[Offset+Half]:Comb[Offset-Half];
+         Type Contrast=Comb[Offset]-Between;
+         Score[Offset]=Contrast;
+         if(Contrast>BestScore) { BestScore=Contrast; BestOffset=Offset; } }
+
+       Type Sum2=0; size_t Count=0;                  // noise from the offsets in quadrature to the best one:
+       for(Offset=(BestOffset+1)&1; Offset<Offsets; Offset+=2) // there the tone leakage cancels out
+       { Sum2+=Score[Offset]*Score[Offset]; Count++; }
+       ScoreRMS = Count ? sqrt(Sum2/Count):0;
+
+       size_t Dist = BestOffset>PrevOffset ? BestOffset-PrevOffset : PrevOffset-BestOffset;
+       if(Dist<=CarrierSepar) BestCount+=1;
+                         else BestCount=1;
+       PrevOffset=BestOffset;
+       return 1; }
+
+   // how far the score for given offset stands out of the others [RMS]
+   Type Significance(size_t Offset)
+     { if(ScoreRMS<=0) return 0;
+       return Score[Offset]/ScoreRMS; }
+
+   // the noise floor of the averaged bin power: its lower quartile,
+   // thus it holds when the signals take up most of the width
+   Type FloorPower(void)
+     { CopyArray(Sorted,BinPower,Width);
+       qsort(Sorted,Width,sizeof(Type),ComparePower);
+       return Sorted[Width/4]; }
+
+  private:
+
+   static int ComparePower(const void *A, const void *B)
+     { Type Diff=(*(const Type *)A)-(*(const Type *)B);
+       return Diff<0 ? -1 : Diff>0 ? 1:0; }
+
+} ;
+
+// =====================================================================
+// Signal pre-detector: tells whether anything like an MFSK signal is present.
+// The measure is the significance of the best tone comb of the frequency search:
+// how far its score stands out of the others [RMS]. The comb integrates
+// the bin power over the synchronizer integration period, thus the detector
+// sees about the signals the synchronizer can lock to, while a per-slice measure
+// (like the spectral peakiness) misses them in noise well before the decoder does.
+// The best comb must as well stay in place for two FEC blocks: the noise peaks jump around.
+
+template <class Type=float>
+ class MFSK_Detector
+{ public:
+
+   MFSK_Parameters<Type> *Parameters;
+
+  public:
+
+   Type Level;                            // significance of the best tone comb [RMS]
+   size_t IdleLen;                        // number of FEC blocks the level stayed below the threshold
+
+  public:
+
+   int Preset(MFSK_Parameters<Type> *NewParameters)
+     { Parameters=NewParameters;
+       Reset();
+       return 0; }
+
+   void Reset(void)
+     { Level=0;
+       IdleLen=0; }
+
+   // save (Load=0) or load (Load=1) the level and the idle count
+   int StateIO(FILE *File, int Load)
+     { if(StateArray(File,Load,&Level,1)<0) return -1;
+       return StateArray(File,Load,&IdleLen,1); }
+
+   // once per FEC block, after the frequency search updated its ranking:
+   // return 1 when a signal is present
+   int Process(MFSK_FreqSearch<Type> &Search)
+     { Level=Search.Significance(Search.BestOffset);
+       if((Level>=Parameters->RxDetectThreshold)&&(Search.BestCount>=2)) { IdleLen=0; return 1; }
+       IdleLen+=1; return 0; }
+
+} ;
+
+// =====================================================================
+
+template <class Type=float>
+ class MFSK_Synchronizer
+{ public:
+
+   MFSK_Parameters<Type> *Parameters;
+
+  public:
+
+   // the user-settable parameters:
+   size_t TrackPhaseMargin; // time-phase window searched when tracking  [spectral slices]
+   size_t TrackFreqMargin;  // frequency offset window searched when tracking [FFT bins]
+   Type TrackThreshold;     // S/N to enter tracking, relative to RxSyncThreshold (a weak lock may be an alias)
+   size_t CoarsePhaseMargin; // time-phase window soft-searched around a coarse pass candidate [spectral slices]
+   size_t CoarseFreqMargin;  // frequency offset window soft-searched around a coarse candidate [FFT bins]
+   size_t CoarseCandidates;  // the top coarse pass peaks soft-searched
+   Type CoarseThreshold;     // [RMS] the top coarse peak above the mean of the coarse integrators to be a clear signal
+
+  private:
+
+   static const int State_Acquire = 0;     // full search over all time-phases and frequency offsets
+   static const int State_Track   = 1;     // search only around the locked time-phase and frequency
+   int State;
+   size_t TrackLockLen;                    // stable lock period to enter the tracking mode [FEC blocks], 0 => never track
+                                           // (when tracking, the integrators outside the window are kept at zero)
+   size_t LockCount;                       // number of consecutive FEC blocks with a stable lock
+
+
+   size_t FreqOffsets;                     // number of possible frequency offsets
+   size_t BlockPhases;                     // number of possible time-phases within the FEC block
+   int SoftBits;                           // soft bits are stored as: 0 => Type, 8 => int8_t, 16 => int16_t
+   MFSK_SoftDecoderBank<Type,Type> Decoder; // bank of decoders, one per frequency offset
+   MFSK_SoftDecoderBank<int16_t,Type,int32_t> Decoder16; // or the same with the quantized soft bits
+   MFSK_SoftDecoderBank<int8_t,Type,int16_t> Decoder8;
+   Type *DecoderSignal;                    // [FreqOffsets] outputs of the bank in use
+   Type *DecoderNoiseEnergy;
+  public:
+   size_t BlockPhase;                      // current running block time-phase
+  private:
+   LowPass3Bank<Type> SyncNoiseEnergy;                       // FEC noise integrators
+   LowPass3Bank<Type> SyncSignal;                            // FEC signal integrators
+   Type SyncFilterWeight;                                    // weight for the integrators
+
+   WorkerPool Pool;                        // threads sharing the frequency offsets
+   Type *PartSignal;                       // best signal found by every worker in the current slice
+   size_t *PartOffset;                     // and its frequency offset
+   Type *SliceSpectra;                     // the job for the workers: the current spectral slice
+   size_t Ranges;                          // the ranges of frequency offsets to search in the current slice
+   size_t *RangeFirst, *RangeLast;         // (sorted, not overlapping), none => just input the spectra
+   uint8_t *Fresh;                         // [BlockPhases][FreqOffsets] the integrators searched when their time-phase
+                                           // came the last time, those outside the search window are kept at zero
+
+   int UseCoarse;                          // acquire with the hard-decision coarse pass:
+   MFSK_HardDecoderBank<Type> Coarse;      // int8 decoders for all the frequency offsets
+   LowPass3Bank<Type> CoarseSignal;        // and their signal integrators
+   int SliceCoarse;                        // run the coarse pass for the current slice
+   size_t CoarseFound;                     // the coarse pass candidates found (at the start of the FEC block)
+   size_t *CoarsePhase;                    // [CoarseCandidates] their time-phases
+   size_t *CoarseOffset;                   // and frequency offsets
+   size_t CoarsePrevPhase, CoarsePrevOffset; // the top candidate of the previous FEC block
+   int CoarseSoftValid;                    // the top candidate which the soft search has been replayed for
+   size_t CoarseSoftPhase, CoarseSoftOffset;
+
+  public:
+
+   int CoarseNew;                         // a new clear coarse pass candidate: the caller should replay
+                                          // the soft search over the history (with CoarseHold)
+   int CoarseHold;                        // keep the coarse pass candidates through Reset() and do not look for new ones
+
+   Type CoarseBestSignal;                 // best signal of the coarse pass
+   size_t CoarseBestBlockPhase;           // and its time-phase
+   size_t CoarseBestFreqOffset;           // and frequency offset
+
+   Type SyncBestSignal;                   // best signal
+   size_t SyncBestBlockPhase;             // time-phase of the best signal        [FFT bins]
+   size_t SyncBestFreqOffset;             // frequency offset of the best signal  [FFT spectral slices]
+   Type SyncSNR;                          // S/N corresponding to the SyncBestSignal
+   int DecodeReference;                   // when 0 then right in the middle of a FEC block
+
+   Type PreciseFreqOffset;                // precise interpolated frequency offset [FFT bins]
+   Type PreciseBlockPhase;                //                   and the FEC block phase [spectral slices]
+   size_t StableLock;                     // is 1 when the sync. looks stable
+   LowPass3_Filter<Type> FreqDrift;       // frequency drift rate [FFT bin / FEC block]
+   LowPass3_Filter<Type> TimeDrift;       // block phase (time) drift rate [ppm]
+
+  public:
+
+   MFSK_Synchronizer()
+     { Init();
+       Default(); }
+
+   ~MFSK_Synchronizer()
+     { Free(); }
+
+   void Init(void)
+     { PartSignal=0;
+       PartOffset=0;
+       RangeFirst=0;
+       RangeLast=0;
+       Fresh=0;
+       CoarsePhase=0;
+       CoarseOffset=0; }
+
+   void Default(void)
+     { TrackPhaseMargin=4;
+       TrackFreqMargin=2;
+       TrackThreshold=2.0;
+       CoarsePhaseMargin=8;
+       CoarseFreqMargin=4;
+       CoarseCandidates=3;
+       CoarseThreshold=6.0;
+       CoarseHold=0; }
+
+   void Free(void)
+     { Decoder.Free();
+       Decoder16.Free();
+       Decoder8.Free();
+       SyncSignal.Free();
+       SyncNoiseEnergy.Free();
+       Pool.Free();
+       free(PartSignal); PartSignal=0;
+       free(PartOffset); PartOffset=0;
+       free(RangeFirst); RangeFirst=0;
+       free(RangeLast); RangeLast=0;
+       free(Fresh); Fresh=0;
+       Coarse.Free();
+       CoarseSignal.Free();
+       free(CoarsePhase); CoarsePhase=0;
+       free(CoarseOffset); CoarseOffset=0;
+     }
+
+   // resize internal arrays according the parameters
+   int Preset(MFSK_Parameters<Type> *NewParameters)
+     { Parameters=NewParameters;
+
+       FreqOffsets=2*Parameters->RxSyncMargin*Parameters->CarrierSepar+1;
+       BlockPhases=Parameters->SpectraPerSymbol*Parameters->SymbolsPerBlock;
+       TrackLockLen=Parameters->RxSyncTrackLen;
+
+       SoftBits=Parameters->RxSyncSoftBits;
+       if(SoftBits==8)
+       { Decoder8.Lanes=FreqOffsets;
+         if(Decoder8.Preset(Parameters)<0) goto Error;
+         DecoderSignal=Decoder8.Signal; DecoderNoiseEnergy=Decoder8.NoiseEnergy; }
+       else if(SoftBits==16)
+       { Decoder16.Lanes=FreqOffsets;
+         if(Decoder16.Preset(Parameters)<0) goto Error;
+         DecoderSignal=Decoder16.Signal; DecoderNoiseEnergy=Decoder16.NoiseEnergy; }
+       else
+       { Decoder.Lanes=FreqOffsets;
+         if(Decoder.Preset(Parameters)<0) goto Error;
+         DecoderSignal=Decoder.Signal; DecoderNoiseEnergy=Decoder.NoiseEnergy; }
 
        SyncSignal.Width=FreqOffsets;
        SyncSignal.Len=BlockPhases;
@@ -2055,6 +3202,26 @@ template <class Type=float>
 
        SyncFilterWeight = 1.0/Parameters->RxSyncIntegLen;
 
+       Pool.Workers=Parameters->RxSyncThreads;
+       if(Pool.Workers>FreqOffsets) Pool.Workers=FreqOffsets;
+       if(Pool.Preset()<0) goto Error;
+       if(ReallocArray(&PartSignal,Pool.Workers)<0) goto Error;
+       if(ReallocArray(&PartOffset,Pool.Workers)<0) goto Error;
+       if(ReallocArray(&Fresh,BlockPhases*FreqOffsets)<0) goto Error;
+
+       UseCoarse=Parameters->RxSyncHardPass;
+       if(CoarseCandidates<1) CoarseCandidates=1;
+       if(ReallocArray(&RangeFirst,CoarseCandidates)<0) goto Error;
+       if(ReallocArray(&RangeLast,CoarseCandidates)<0) goto Error;
+       if(UseCoarse)
+       { Coarse.Lanes=FreqOffsets;
+         if(Coarse.Preset(Parameters)<0) goto Error;
+         CoarseSignal.Width=FreqOffsets;
+         CoarseSignal.Len=BlockPhases;
+         if(CoarseSignal.Preset()<0) goto Error;
+         if(ReallocArray(&CoarsePhase,CoarseCandidates)<0) goto Error;
+         if(ReallocArray(&CoarseOffset,CoarseCandidates)<0) goto Error; }
+
        Reset();
 
        return 0;
@@ -2062,13 +3229,14 @@ template <class Type=float>
        Error: Free(); return -1; }
 
    void Reset(void)
-     { size_t Idx;
-
-       for(Idx=0; Idx<FreqOffsets; Idx++)
-         Decoder[Idx].Reset();
+     {
+       if(SoftBits==8) Decoder8.Reset();
+       else if(SoftBits==16) Decoder16.Reset();
+       else Decoder.Reset();
 
        SyncSignal.Clear();
        SyncNoiseEnergy.Clear();
+       ClearArray(Fresh,BlockPhases*FreqOffsets);
 
        BlockPhase=0;
 
@@ -2084,41 +3252,265 @@ template <class Type=float>
        FreqDrift=0;
        TimeDrift=0;
 
+       State=State_Acquire;
+       LockCount=0;
+
+       if(UseCoarse)
+       { Coarse.Reset();
+         CoarseSignal.Clear(); }
+       CoarseNew=0;
+       if(CoarseHold) return;
+       CoarseFound=0;
+       CoarseBestSignal=0;
+       CoarseBestBlockPhase=0;
+       CoarseBestFreqOffset=FreqOffsets/2;
+       CoarsePrevPhase=0;
+       CoarsePrevOffset=FreqOffsets;                 // no candidate in the previous block
+       CoarseSoftValid=0;
+       CoarseSoftPhase=0;
+       CoarseSoftOffset=0;
 	 }
 
+   // save (Load=0) or load (Load=1) the decoders, the integrators and the lock,
+   // the synchronizer must be preset the same
+   int StateIO(FILE *File, int Load)
+     { if(SoftBits==8) { if(Decoder8.StateIO(File,Load)<0) goto Error; }
+       else if(SoftBits==16) { if(Decoder16.StateIO(File,Load)<0) goto Error; }
+       else { if(Decoder.StateIO(File,Load)<0) goto Error; }
+       if(SyncSignal.StateIO(File,Load)<0) goto Error;
+       if(SyncNoiseEnergy.StateIO(File,Load)<0) goto Error;
+       if(StateArray(File,Load,Fresh,BlockPhases*FreqOffsets)<0) goto Error;
+       if(UseCoarse)
+       { if(Coarse.StateIO(File,Load)<0) goto Error;
+         if(CoarseSignal.StateIO(File,Load)<0) goto Error;
+         if(StateArray(File,Load,&CoarseFound,1)<0) goto Error;
+         if(CoarseFound>CoarseCandidates) goto Error;
+         if(StateArray(File,Load,CoarsePhase,CoarseFound)<0) goto Error;
+         if(StateArray(File,Load,CoarseOffset,CoarseFound)<0) goto Error;
+         if(StateArray(File,Load,&CoarsePrevPhase,1)<0) goto Error;
+         if(StateArray(File,Load,&CoarsePrevOffset,1)<0) goto Error;
+         if(StateArray(File,Load,&CoarseSoftValid,1)<0) goto Error;
+         if(StateArray(File,Load,&CoarseSoftPhase,1)<0) goto Error;
+         if(StateArray(File,Load,&CoarseSoftOffset,1)<0) goto Error; }
+       if(StateArray(File,Load,&State,1)<0) goto Error;
+       if(StateArray(File,Load,&LockCount,1)<0) goto Error;
+       if(StateArray(File,Load,&BlockPhase,1)<0) goto Error;
+       if(StateArray(File,Load,&CoarseBestSignal,1)<0) goto Error;
+       if(StateArray(File,Load,&CoarseBestBlockPhase,1)<0) goto Error;
+       if(StateArray(File,Load,&CoarseBestFreqOffset,1)<0) goto Error;
+       if(StateArray(File,Load,&SyncBestSignal,1)<0) goto Error;
+       if(StateArray(File,Load,&SyncBestBlockPhase,1)<0) goto Error;
+       if(StateArray(File,Load,&SyncBestFreqOffset,1)<0) goto Error;
+       if(StateArray(File,Load,&SyncSNR,1)<0) goto Error;
+       if(StateArray(File,Load,&DecodeReference,1)<0) goto Error;
+       if(StateArray(File,Load,&PreciseFreqOffset,1)<0) goto Error;
+       if(StateArray(File,Load,&PreciseBlockPhase,1)<0) goto Error;
+       if(StateArray(File,Load,&StableLock,1)<0) goto Error;
+       if(StateArray(File,Load,&FreqDrift,1)<0) goto Error;
+       if(StateArray(File,Load,&TimeDrift,1)<0) goto Error;
+       if((BlockPhase>=BlockPhases)||(SyncBestBlockPhase>=BlockPhases)||(CoarseBestBlockPhase>=BlockPhases)
+        ||(SyncBestFreqOffset>=FreqOffsets)||(CoarseBestFreqOffset>=FreqOffsets)) goto Error;
+       return 0;
+
+       Error: if(Load) Reset();
+       return -1; }
+
+   // is 1 when the synchronizer only searches around the locked signal
+   int Tracking(void)
+     { return State==State_Track; }
+
    void Process(Type *Spectra)
-     { size_t Offset;
+     {
+       SliceCoarse=UseCoarse&&(State!=State_Track);
+       if(SliceCoarse&&(BlockPhase==0)&&(!CoarseHold)) FindCoarse();
+       Ranges=0;                                     // by default search all offsets at all time-phases
+       if(State==State_Track)                        // when tracking: only a window around the lock
+         AddRange(SyncBestBlockPhase, SyncBestFreqOffset, TrackPhaseMargin, TrackFreqMargin);
+       else if(UseCoarse)                            // acquiring with the coarse pass: windows around its candidates
+       { size_t Cand;
+         for(Cand=0; Cand<CoarseFound; Cand++)
+           AddRange(CoarsePhase[Cand], CoarseOffset[Cand], CoarsePhaseMargin, CoarseFreqMargin); }
+       else
+       { RangeFirst[0]=0; RangeLast[0]=FreqOffsets-1; Ranges=1; }
+       int Search = Ranges>0;
+       if((!Search)&&(BlockPhase==SyncBestBlockPhase)) SyncBestSignal=0; // the best is outside the window now
+
+       SliceSpectra=Spectra;
+       if(State==State_Track) ProcessPart(0,FreqOffsets,0);  // too little work to share between threads
+                         else Pool.Run(ProcessJob,this);     // otherwise workers take equal parts
+       if(SoftBits==8) Decoder8.NextSlice();
+       else if(SoftBits==16) Decoder16.NextSlice();
+       else Decoder.NextSlice();
+       if(UseCoarse) Coarse.NextSlice();
+
+       if(Search)
+       { size_t Workers = State==State_Track ? 1:Pool.Workers;
+         Type BestSliceSignal=0;                        // reduce the best signal found by the workers
+         size_t BestSliceOffset=RangeFirst[0];
+         size_t Worker;
+         for(Worker=0; Worker<Workers; Worker++)
+         { if(PartSignal[Worker]>BestSliceSignal)
+           { BestSliceSignal=PartSignal[Worker];
+             BestSliceOffset=PartOffset[Worker]; }
+         }
+         UpdateBest(BestSliceSignal,BestSliceOffset); }
 
-	   MFSK_SoftDecoder<Type,Type> *DecoderPtr = Decoder;
-       LowPass3_Filter<Type> *SignalPtr        = SyncSignal[BlockPhase];
-       LowPass3_Filter<Type> *NoiseEnergyPtr   = SyncNoiseEnergy[BlockPhase];
+       DecodeReference=(int)BlockPhase-(int)SyncBestBlockPhase;
+       if(DecodeReference<0) DecodeReference+=BlockPhases;
+	   DecodeReference-=(int)(BlockPhases/2);
+       if(DecodeReference==0) UpdateLock();
 
-       // printf("%3d:",BlockPhase);
-       Type BestSliceSignal=0;
-       size_t BestSliceOffset=0;
-	   for(Offset=0; Offset<FreqOffsets; Offset++)
-	   { DecoderPtr->SpectralInput(Spectra+Offset);
-	     DecoderPtr->Process();
-         Type NoiseEnergy = DecoderPtr->NoiseEnergy;
-         Type Signal = DecoderPtr->Signal;
+	   SyncSignal.IncrPtr(BlockPhase);
+	 }
 
-         // printf(" %4.1f",Signal);
+  private:
 
-         NoiseEnergyPtr->Process(NoiseEnergy, SyncFilterWeight);
-         SignalPtr->Process(Signal, SyncFilterWeight);
-         Signal=SignalPtr->Output;
+   // search the window around the given time-phase and frequency offset when the current time-phase
+   // is within it: add its frequency offsets to the (sorted) ranges, merging the overlapping ones
+   void AddRange(size_t Phase, size_t Offset, size_t PhaseMargin, size_t FreqMargin)
+     { int PhaseDist=(int)BlockPhase-(int)Phase;
+       SyncSignal.WrapDiffPhase(PhaseDist);
+       if(abs(PhaseDist)>(int)PhaseMargin) return;
+       size_t First = Offset>FreqMargin ? Offset-FreqMargin : 0;
+       size_t Last = (Offset+FreqMargin)<FreqOffsets ? Offset+FreqMargin : FreqOffsets-1;
+       size_t Idx;
+       for(Idx=Ranges; (Idx>0)&&(RangeFirst[Idx-1]>First); Idx--)
+       { RangeFirst[Idx]=RangeFirst[Idx-1]; RangeLast[Idx]=RangeLast[Idx-1]; }
+       RangeFirst[Idx]=First; RangeLast[Idx]=Last; Ranges+=1;
+       size_t Merged=0;
+       for(Idx=1; Idx<Ranges; Idx++)
+       { if(RangeFirst[Idx]<=(RangeLast[Merged]+1))
+         { if(RangeLast[Idx]>RangeLast[Merged]) RangeLast[Merged]=RangeLast[Idx]; }
+         else
+         { Merged+=1; RangeFirst[Merged]=RangeFirst[Idx]; RangeLast[Merged]=RangeLast[Idx]; }
+       }
+       Ranges=Merged+1; }
+
+   // once per FEC block: the top coarse pass peaks, each outside the soft-search window of the higher ones;
+   // the soft search integrators start only as a window covers them, thus a new top candidate
+   // which stays for two blocks and stands out of the noise asks for a replay over the history
+   void FindCoarse(void)
+     { CoarseFound=0;
+       Type TopSignal=0;
+       Type Sum=0, Sum2=0;
+       size_t Cand;
+       for(Cand=0; Cand<CoarseCandidates; Cand++)
+       { Type BestSignal=0;
+         size_t BestPhase=0, BestOffset=0;
+         size_t Phase,Offset;
+         for(Phase=0; Phase<BlockPhases; Phase++)
+         { Type *Signal=CoarseSignal[Phase];
+           if(Cand==0)
+           { for(Offset=0; Offset<FreqOffsets; Offset++)
+             { Sum+=Signal[Offset]; Sum2+=Signal[Offset]*Signal[Offset]; }
+           }
+           for(Offset=0; Offset<FreqOffsets; Offset++)
+           { if(Signal[Offset]<=BestSignal) continue;
+             if(InCoarseWindow(Phase,Offset)) continue;
+             BestSignal=Signal[Offset]; BestPhase=Phase; BestOffset=Offset; }
+         }
+         if(BestSignal<=0) break;
+         CoarsePhase[CoarseFound]=BestPhase;
+         CoarseOffset[CoarseFound]=BestOffset;
+         CoarseFound+=1;
+         if(Cand==0)
+         { CoarseBestSignal=TopSignal=BestSignal;
+           CoarseBestBlockPhase=BestPhase;
+           CoarseBestFreqOffset=BestOffset; }
+       }
+       if(CoarseFound==0) return;
+       Type Cells=BlockPhases*FreqOffsets;
+       Type Mean=Sum/Cells;
+       Type RMS=Sum2/Cells-Mean*Mean; RMS = RMS>0 ? sqrt(RMS):0;
+       int Stays = CoarseNear(CoarsePrevPhase,CoarsePrevOffset);
+       int Clear = TopSignal>=(Mean+CoarseThreshold*RMS);
+       int New = (!CoarseSoftValid)||(!CoarseNear(CoarseSoftPhase,CoarseSoftOffset));
+       if(Stays&&Clear&&New&&(!StableLock))
+       { CoarseNew=1;
+         CoarseSoftValid=1; CoarseSoftPhase=CoarsePhase[0]; CoarseSoftOffset=CoarseOffset[0]; }
+       CoarsePrevPhase=CoarsePhase[0]; CoarsePrevOffset=CoarseOffset[0];
+     }
 
-         // printf("/%4.1f",Signal);
+   // is the given time-phase and frequency offset within the soft-search window of the top coarse candidate
+   int CoarseNear(size_t Phase, size_t Offset)
+     { int PhaseDist=(int)Phase-(int)CoarsePhase[0];
+       SyncSignal.WrapDiffPhase(PhaseDist);
+       if(abs(PhaseDist)>(int)CoarsePhaseMargin) return 0;
+       size_t Dist = Offset>CoarseOffset[0] ? Offset-CoarseOffset[0] : CoarseOffset[0]-Offset;
+       return Dist<=CoarseFreqMargin; }
+
+   // is the time-phase and frequency offset within the soft-search window of a coarse candidate found so far
+   int InCoarseWindow(size_t Phase, size_t Offset)
+     { size_t Other;
+       for(Other=0; Other<CoarseFound; Other++)
+       { int PhaseDist=(int)Phase-(int)CoarsePhase[Other];
+         SyncSignal.WrapDiffPhase(PhaseDist);
+         if(abs(PhaseDist)>(int)CoarsePhaseMargin) continue;
+         size_t Dist = Offset>CoarseOffset[Other] ? Offset-CoarseOffset[Other] : CoarseOffset[Other]-Offset;
+         if(Dist<=CoarseFreqMargin) return 1; }
+       return 0; }
+
+   static void ProcessJob(void *Context, size_t Worker)
+     { MFSK_Synchronizer<Type> *Sync=(MFSK_Synchronizer<Type> *)Context;
+       size_t Start,Stop;
+       Sync->Pool.Part(Worker,Sync->FreqOffsets,Start,Stop);
+       Sync->ProcessPart(Start,Stop,Worker); }
+
+   // input the current slice to the soft decoders [Start..Stop)
+   void DecoderInput(size_t Start, size_t Stop)
+     { if(SoftBits==8) Decoder8.SpectralInput(SliceSpectra,Start,Stop);
+       else if(SoftBits==16) Decoder16.SpectralInput(SliceSpectra,Start,Stop);
+       else Decoder.SpectralInput(SliceSpectra,Start,Stop); }
+
+   // keep the integrators of the current time-phase [Start..Stop) outside the search ranges at zero:
+   // clear those which enter or leave the ranges, as they were not updated (or will not be)
+   void UpdateFresh(size_t Start, size_t Stop)
+     { uint8_t *Row=Fresh+BlockPhase*FreqOffsets;
+       size_t Range=0;
+       size_t Idx;
+       for(Idx=Start; Idx<Stop; Idx++)
+       { while((Range<Ranges)&&(Idx>RangeLast[Range])) Range++;
+         uint8_t In = (Range<Ranges)&&(Idx>=RangeFirst[Range]);
+         if(In==Row[Idx]) continue;
+         SyncSignal.ClearRow(BlockPhase,Idx,Idx+1);
+         SyncNoiseEnergy.ClearRow(BlockPhase,Idx,Idx+1);
+         Row[Idx]=In; }
+     }
+
+   // process the current slice for the frequency offsets [Start..Stop)
+   void ProcessPart(size_t Start, size_t Stop, size_t Part)
+     {
+       if(UseCoarse) Coarse.SpectralInput(SliceSpectra,Start,Stop);
+       DecoderInput(Start,Stop);                        // every decoder needs the input, even when not searching
+
+       if(SliceCoarse)                                  // the coarse pass runs for all the offsets
+       { Coarse.Process(Start,Stop);
+         CoarseSignal.ProcessRow(BlockPhase, Coarse.Signal, SyncFilterWeight, Start, Stop); }
+
+       UpdateFresh(Start,Stop);
 
-         if(Signal>BestSliceSignal)
-         { BestSliceSignal=Signal;
-           BestSliceOffset=Offset; }
+       PartSignal[Part]=0;
+       PartOffset[Part] = Ranges ? RangeFirst[0]:0;
+       size_t Range;
+       for(Range=0; Range<Ranges; Range++)
+       { size_t First = Start>RangeFirst[Range] ? Start:RangeFirst[Range];
+         size_t Last = Stop<(RangeLast[Range]+1) ? Stop:(RangeLast[Range]+1);
+         if(First>=Last) continue;
 
-         DecoderPtr++;
-         NoiseEnergyPtr++;
-         SignalPtr++;
-	   } // printf("\n");
+         if(SoftBits==8) Decoder8.Process(First,Last);
+         else if(SoftBits==16) Decoder16.Process(First,Last);
+         else Decoder.Process(First,Last);
 
+         SyncNoiseEnergy.ProcessRow(BlockPhase, DecoderNoiseEnergy, SyncFilterWeight, First, Last);
+
+         size_t BestOffset=SyncSignal.ProcessRowPeak(BlockPhase, DecoderSignal, SyncFilterWeight,
+                                                     First, Last, PartSignal[Part]);
+         if(BestOffset<Last) PartOffset[Part]=BestOffset; }
+     }
+
+   // update the best signal with the best of the current slice
+   void UpdateBest(Type BestSliceSignal, size_t BestSliceOffset)
+     {
        if(BlockPhase==SyncBestBlockPhase)
        { SyncBestSignal=BestSliceSignal;
          SyncBestFreqOffset=BestSliceOffset;
@@ -2133,66 +3525,84 @@ template <class Type=float>
        printf("MFSK_Synchronizer: %4.1f @ %3d:%3d\n",
 	                             SyncBestSignal, SyncBestBlockPhase, SyncBestFreqOffset);
 */
-       DecodeReference=(int)BlockPhase-(int)SyncBestBlockPhase;
-       if(DecodeReference<0) DecodeReference+=BlockPhases;
-	   DecodeReference-=(int)(BlockPhases/2);
-       if(DecodeReference==0)
-       { Type BestNoise=SyncNoiseEnergy[SyncBestBlockPhase][SyncBestFreqOffset].Output;
-         if(BestNoise>0) BestNoise=sqrt(BestNoise);
+     }
+
+   // once per FEC block: measure the S/N, fit the precise lock position and select the search mode
+   void UpdateLock(void)
+     { Type BestNoise=SyncNoiseEnergy[SyncBestBlockPhase][SyncBestFreqOffset];
+       if(BestNoise>0) BestNoise=sqrt(BestNoise);
 		            else BestNoise=0;
-         const Type MinNoise=(Type)Parameters->SymbolsPerBlock/10000;
-         if(BestNoise<MinNoise) BestNoise=MinNoise;
+       const Type MinNoise=(Type)Parameters->SymbolsPerBlock/10000;
+       if(BestNoise<MinNoise) BestNoise=MinNoise;
 
-         SyncSNR = SyncBestSignal/BestNoise;
+       SyncSNR = SyncBestSignal/BestNoise;
 
-         Type NewPreciseFreqOffset;
-         Type SignalPeak;
-         LowPass3_Filter<Type> *Signal = SyncSignal[SyncBestBlockPhase];
-         size_t FitIdx=Limit(SyncBestFreqOffset,(size_t)1,(size_t)(FreqOffsets-2));
+       Type NewPreciseFreqOffset;
+       Type SignalPeak;
+       Type *Signal = SyncSignal[SyncBestBlockPhase];
+       size_t FitIdx=Limit(SyncBestFreqOffset,(size_t)1,(size_t)(FreqOffsets-2));
 		 int FitOK=FitPeak(NewPreciseFreqOffset, SignalPeak,
-		                   Signal[FitIdx-1].Output, Signal[FitIdx].Output, Signal[FitIdx+1].Output);
-         if(FitOK<0) NewPreciseFreqOffset=SyncBestFreqOffset;
-                else NewPreciseFreqOffset=FitIdx+Limit(NewPreciseFreqOffset,(Type)-1.0,(Type)1.0);
+		                   Signal[FitIdx-1], Signal[FitIdx], Signal[FitIdx+1]);
+       if(FitOK<0) NewPreciseFreqOffset=SyncBestFreqOffset;
+              else NewPreciseFreqOffset=FitIdx+Limit(NewPreciseFreqOffset,(Type)-1.0,(Type)1.0);
 
-         Type NewPreciseBlockPhase;
-         size_t FitIdxL=SyncBestBlockPhase;
+       Type NewPreciseBlockPhase;
+       size_t FitIdxL=SyncBestBlockPhase;
 	     SyncSignal.DecrPtr(FitIdxL);
-         size_t FitIdxC=SyncBestBlockPhase;
-         size_t FitIdxR=SyncBestBlockPhase;
+       size_t FitIdxC=SyncBestBlockPhase;
+       size_t FitIdxR=SyncBestBlockPhase;
 	     SyncSignal.IncrPtr(FitIdxR);
 		 FitOK=FitPeak(NewPreciseBlockPhase, SignalPeak,
-		                 SyncSignal[FitIdxL][SyncBestFreqOffset].Output,
-		                 SyncSignal[FitIdxC][SyncBestFreqOffset].Output,
-		                 SyncSignal[FitIdxR][SyncBestFreqOffset].Output);
-         if(FitOK<0) { NewPreciseBlockPhase=SyncBestBlockPhase; }
-                else { NewPreciseBlockPhase+=FitIdxC; SyncSignal.WrapPhase(NewPreciseBlockPhase); }
-
-         Type FreqDelta=NewPreciseFreqOffset-PreciseFreqOffset;
-         Type PhaseDelta=NewPreciseBlockPhase-PreciseBlockPhase;
-         SyncSignal.WrapDiffPhase(PhaseDelta);
-
-         Type DeltaDist2=FreqDelta*FreqDelta+PhaseDelta*PhaseDelta;
-         if((DeltaDist2<=1.0)&&(SyncSNR>=Parameters->RxSyncThreshold))
+		                 SyncSignal[FitIdxL][SyncBestFreqOffset],
+		                 SyncSignal[FitIdxC][SyncBestFreqOffset],
+		                 SyncSignal[FitIdxR][SyncBestFreqOffset]);
+       if(FitOK<0) { NewPreciseBlockPhase=SyncBestBlockPhase; }
+              else { NewPreciseBlockPhase+=FitIdxC; SyncSignal.WrapPhase(NewPreciseBlockPhase); }
+
+       Type FreqDelta=NewPreciseFreqOffset-PreciseFreqOffset;
+       Type PhaseDelta=NewPreciseBlockPhase-PreciseBlockPhase;
+       SyncSignal.WrapDiffPhase(PhaseDelta);
+
+       Type DeltaDist2=FreqDelta*FreqDelta+PhaseDelta*PhaseDelta;
+       if((DeltaDist2<=1.0)&&(SyncSNR>=Parameters->RxSyncThreshold))
 		 { StableLock=1;
-           FreqDrift.Process(FreqDelta, SyncFilterWeight);
-           TimeDrift.Process(PhaseDelta/BlockPhases, SyncFilterWeight); }
+         FreqDrift.Process(FreqDelta, SyncFilterWeight);
+         TimeDrift.Process(PhaseDelta/BlockPhases, SyncFilterWeight); }
 		 else
 		 { StableLock=0; FreqDrift=0; TimeDrift=0; }
 /*
-         printf("%d: %4d (%6.2f %+5.2f %+5.0f ppm) / %+2d (%+5.3f %+5.2f %+7.4f) => %4.1f/%3.1f = %4.1f\n",
-             StableLock,
-             SyncBestBlockPhase, NewPreciseBlockPhase, PhaseDelta, 1E6*TimeDrift.Output,
-             (int)SyncBestFreqOffset-(FreqOffsets/2),  NewPreciseFreqOffset-(FreqOffsets/2), FreqDelta, FreqDrift.Output,
-             SyncBestSignal, BestNoise,
-             SyncSNR);
+       printf("%d: %4d (%6.2f %+5.2f %+5.0f ppm) / %+2d (%+5.3f %+5.2f %+7.4f) => %4.1f/%3.1f = %4.1f\n",
+           StableLock,
+           SyncBestBlockPhase, NewPreciseBlockPhase, PhaseDelta, 1E6*TimeDrift.Output,
+           (int)SyncBestFreqOffset-(FreqOffsets/2),  NewPreciseFreqOffset-(FreqOffsets/2), FreqDelta, FreqDrift.Output,
+           SyncBestSignal, BestNoise,
+           SyncSNR);
 */
-         PreciseFreqOffset=NewPreciseFreqOffset;
-         PreciseBlockPhase=NewPreciseBlockPhase;
-
-       }
-	   SyncSignal.IncrPtr(BlockPhase);
+       PreciseFreqOffset=NewPreciseFreqOffset;
+       PreciseBlockPhase=NewPreciseBlockPhase;
+
+       if(StableLock) { if(LockCount<TrackLockLen) LockCount+=1; }
+                 else LockCount=0;
+       if(TrackLockLen&&(LockCount>=TrackLockLen)                     // stable and strong lock: search around it only
+        &&((State==State_Track)||(SyncSNR>=TrackThreshold*Parameters->RxSyncThreshold))) State=State_Track;
+       else                                                             // no lock: search everything
+       { if(State==State_Track) ClearStale();
+         State=State_Acquire; }
 	 }
 
+   // back from tracking: the coarse pass integrators did not run, start them from scratch
+   // (the soft-search integrators outside the tracking window are already kept at zero)
+   void ClearStale(void)
+     { if(!UseCoarse) return;
+       CoarseSignal.Clear();
+       CoarseBestSignal=0;
+       CoarseBestBlockPhase=CoarsePhase[0]=SyncBestBlockPhase;   // meanwhile search around the lost lock
+       CoarseBestFreqOffset=CoarseOffset[0]=SyncBestFreqOffset;
+       CoarseFound=1;
+       CoarseSoftValid=1; CoarseSoftPhase=SyncBestBlockPhase; CoarseSoftOffset=SyncBestFreqOffset; }
+
+  public:
+
    Type FEC_SNR(void)
      { return SyncSNR; }
 
@@ -2286,6 +3696,122 @@ How to use the MFSK_Receiver class:
 
 */
 
+// monotonic time for the statistics [ns]
+inline uint64_t MFSK_NanoTime(void)
+{ struct timespec Time;
+  clock_gettime(CLOCK_MONOTONIC,&Time);
+  return (uint64_t)Time.tv_sec*1000000000+Time.tv_nsec; }
+
+// calls and time spent in one processing stage
+class MFSK_StageStats
+{ public:
+
+   size_t Calls;                  // number of calls
+   uint64_t TotalTime;            // [ns] total time
+   uint64_t MaxTime;              // [ns] the longest call
+
+   void Reset(void)
+     { Calls=0; TotalTime=0; MaxTime=0; }
+
+   void Add(uint64_t Time)
+     { Calls+=1; TotalTime+=Time;
+       if(Time>MaxTime) MaxTime=Time; }
+
+   void Print(const char *Name, FILE *File=stdout)
+     { fprintf(File,"%-16s %9lu calls %10.3f ms total %9.2f us/call %9.2f us max\n",
+               Name, (unsigned long)Calls, 1E-6*TotalTime,
+               Calls ? 1E-3*TotalTime/Calls:0.0, 1E-3*MaxTime); }
+
+} ;
+
+// the per-stage statistics of a receiver (collected when Parameters->RxStats)
+class MFSK_ReceiverStats
+{ public:
+
+   MFSK_StageStats RateConverter;     // input rate conversion
+   MFSK_StageStats InputProcessor;    // input equalizer and interference limiter
+   MFSK_StageStats Demodulator;       // symbol FFTs
+   MFSK_StageStats FreqSearch;        // coarse frequency search over the wide margin
+   MFSK_StageStats Synchronizer;      // time and frequency synchronizer
+   MFSK_StageStats DecodeSearch;      // trial decodes around the synchronizer time and frequency
+   MFSK_StageStats Decoder;           // the final decode of a FEC block
+   size_t SearchIter;                 // decoder iterations of the trial decodes
+   size_t DecodeIter;                 // and of the final decodes
+
+   MFSK_ReceiverStats()
+     { Reset(); }
+
+   void Reset(void)
+     { RateConverter.Reset();
+       InputProcessor.Reset();
+       Demodulator.Reset();
+       FreqSearch.Reset();
+       Synchronizer.Reset();
+       DecodeSearch.Reset();
+       Decoder.Reset();
+       SearchIter=0; DecodeIter=0; }
+
+   void Print(FILE *File=stdout)
+     { RateConverter.Print("RateConverter",File);
+       InputProcessor.Print("InputProcessor",File);
+       Demodulator.Print("Demodulator",File);
+       FreqSearch.Print("FreqSearch",File);
+       Synchronizer.Print("Synchronizer",File);
+       DecodeSearch.Print("DecodeSearch",File);
+       Decoder.Print("Decoder",File);
+       fprintf(File,"Decoder iterations: %lu search, %lu final\n",
+               (unsigned long)SearchIter, (unsigned long)DecodeIter); }
+
+} ;
+
+// point the decoder to a FEC block in the spectra history (or copy it when it can not be viewed)
+template <class Type>
+ int MFSK_PickDecoderInput(MFSK_Demodulator<Type> &Demodulator, MFSK_SoftIterDecoder<Type> &Decoder,
+                           int TimeOffset, int FreqOffset)
+{ int Error=Demodulator.PickView(Decoder.InputView,TimeOffset,FreqOffset);
+  if(Error!=(-2)) return Error;
+  Decoder.UseInput();
+  return Demodulator.PickBlock(Decoder.Input,TimeOffset,FreqOffset); }
+
+// decode a FEC block searching around the given time and frequency offset,
+// the time offset is moved to the best one, the time spent goes to Stats (if given)
+template <class Type>
+ int MFSK_DecodeBlock(MFSK_Demodulator<Type> &Demodulator, MFSK_SoftIterDecoder<Type> &Decoder,
+                      int &TimeOffset, int FreqOffset, MFSK_ReceiverStats *Stats=0)
+{ uint64_t Start = Stats ? MFSK_NanoTime():0;
+  Type BestSignal=0;
+  int BestTime=0;
+  int BestFreq=0;
+  int FreqSearch;
+  for(FreqSearch=(-1); FreqSearch<=1; FreqSearch++)
+  { int TimeSearch;
+    for(TimeSearch=(-2); TimeSearch<=2; TimeSearch++)
+    { int Error=MFSK_PickDecoderInput(Demodulator,Decoder,TimeOffset+TimeSearch,FreqOffset+FreqSearch);
+      if(Error<0) continue;
+      Decoder.Process(8);
+      if(Stats) Stats->SearchIter+=8;
+      // printf("%+2d/%+2d: ", FreqSearch, TimeSearch);
+      // Decoder.PrintSNR();
+      Type Signal=Decoder.Input_SignalEnergy;
+      if(Signal>BestSignal)
+      { BestSignal=Signal; BestFreq=FreqSearch; BestTime=TimeSearch; }
+    }
+  }
+  TimeOffset+=BestTime;
+  if(Stats)
+  { uint64_t Now=MFSK_NanoTime();
+    Stats->DecodeSearch.Add(Now-Start); Start=Now; }
+  if(MFSK_PickDecoderInput(Demodulator,Decoder,TimeOffset,FreqOffset+BestFreq)<0) return -1; // beyond the history
+  Decoder.Process(32);
+  if(Stats)
+  { Stats->Decoder.Add(MFSK_NanoTime()-Start);
+    Stats->DecodeIter+=32; }
+  // printf("Best: %+2d/%+2d: ", BestFreq, BestTime);
+  // Decoder.PrintSNR();
+  return 0; }
+
+// =====================================================================
+
 template <class Type=float>
  class MFSK_Receiver
 { public:
@@ -2294,17 +3820,65 @@ template <class Type=float>
 
   private:
 
-   RateConverter<Type> RateConverter;
-   Seq<Type> InputBuffer;
+   RateConverter<Type> InputRateConverter;
+   MirrorBuffer<Type> InputBuffer;           // rate converter output, read one input processor window at a time
+   size_t InputFill;                         // samples waiting in InputBuffer (from its pointer on)
    MFSK_InputProcessor<Type> InputProcessor; // equalizes the input spectrum
                                              // and removes coherent interferences
    MFSK_Demodulator<Type> Demodulator;       // spectral (FFT) demodulator
+   MFSK_FreqSearch<Type> FreqSearch;         // coarse frequency search over the wide margin
    MFSK_Synchronizer<Type> Synchronizer;     // synchronizer
+   size_t SyncBase;                          // where the synchronizer window starts in the spectra [FFT bins]
+   MFSK_Detector<Type> Detector;             // signal pre-detector
+   int SyncActive;                           // the synchronizer runs (or sleeps as the band is idle)
+   int Parked;                               // the synchronizer sleeps as another receiver decodes the signal
    MFSK_SoftIterDecoder<Type> Decoder;       // iterative decoder
-   FIFO<uint8_t> Output;                     // buffer for decoded characters
+   LockFreeFIFO<uint8_t> Output;             // buffer for decoded characters (written by the decoder stage)
+   LockFreeFIFO<uint8_t> OutputFlag;         // and their flags (with early decoding)
+   Type *ZeroSlice;                          // [Demodulator.SliceLen()] zero energies for DrainSpectra()
+
+   size_t SliceCount;                        // spectral slices processed so far (the time of the history)
+   size_t *EarlyStart;                       // [EarlyLen] where the provisionally decoded blocks start [slices]
+   size_t EarlyLen;                          // early blocks not yet confirmed:
+   size_t EarlyHead, EarlyCount;             // the oldest one and how many
+
+                                             // pipelined mode: the stages 0=input processor, 1=demodulator
+   size_t Stage[3];                          // and 2=decoder run on these threads, 0 => the caller
+                                             // (the rate converter stays with the input processor: it is cheap
+                                             //  and writes straight into the input processor window buffer;
+                                             //  the synchronizer stays with the decoder: the decoder reads
+                                             //  the spectra history and the lock at the slice the synchronizer
+                                             //  is on, and the replays rewind both, thus apart they would need
+                                             //  a copy of the history each and the lock passed back and forth)
+   BlockQueue<Type> StageInput[3];           // input to a stage on another thread than the stage before
+   static const int StageData=0, StageFlush=1, StageDrain=2, StageSync=3, StageStop=4; // slot tags
+   size_t Threads;                           // number of background threads running
+   pthread_t Thread[3];
+   struct ThreadArg
+   { MFSK_Receiver *Receiver;
+     size_t Thread; } Arg[3];
+   sem_t Synced;                             // a sync message passed the last stage
+
+   struct StatusSnapshot                     // what the status getters return: stored by the decoder stage
+   { Type SyncSNR, FrequencyOffset;          // after every symbol, thus another thread may read it
+     Type FrequencyDrift, TimeDrift;         // while the stages run (every field is atomic on its own)
+     Type InputSNRdB;
+     int StableLock; } Status;
+
+   static const uint32_t StateMagic=0x4D46534B;     // "MFSK": the SaveState() format,
+   static const uint32_t StateVersion=3;            // its version
+   static const uint32_t StateByteOrder=0x01020304; // and a word which reads different with the other byte order
 
   public:
 
+   MFSK_ReceiverStats Stats;                 // per-stage timing when Parameters->RxStats, since Preset()
+                                             // (when pipelined, up to date only after Flush())
+
+   static const uint8_t CharFinal=0;         // character flags: a new final character,
+   static const uint8_t CharProvisional=1;   // a provisional one (from the early decode),
+   static const uint8_t CharConfirm=2;       // the final value of the oldest still provisional character,
+   static const uint8_t CharCancel=3;        // or that character is withdrawn (the delayed decode missed its block)
+
    MFSK_Receiver()
      { Init(); }
 
@@ -2312,114 +3886,580 @@ template <class Type=float>
      { Free(); }
 
    void Init(void)
-     { }
+     { ZeroSlice=0;
+       EarlyStart=0;
+       Threads=0;
+       Stage[0]=Stage[1]=Stage[2]=0; }
 
    void Free(void)
-     { RateConverter.Free();
+     { StopPipeline();
+       InputRateConverter.Free();
        InputBuffer.Free();
        InputProcessor.Free();
        Demodulator.Free();
+       FreqSearch.Free();
        Synchronizer.Free();
        Decoder.Free();
-       Output.Free(); }
+       Output.Free();
+       OutputFlag.Free();
+       free(ZeroSlice); ZeroSlice=0;
+       free(EarlyStart); EarlyStart=0; }
 
    // resize internal arrays according the parameters
    int Preset(MFSK_Parameters<Type> *NewParameters)
-     { Parameters=NewParameters;
+     { StopPipeline();
+       Parameters=NewParameters;
 
-       RateConverter.OutputRate=Parameters->SampleRate/Parameters->InputSampleRate;
-       if(RateConverter.Preset()<0) goto Error;
+       InputRateConverter.OutputRate=Parameters->SampleRate/Parameters->InputSampleRate;
+       if(InputRateConverter.Preset()<0) goto Error;
 
        InputProcessor.WindowLen=32*Parameters->SymbolSepar;
+       if(Parameters->RxBandLimit||Parameters->RxBaseband) // the band the demodulator looks at
+       { size_t Scale=InputProcessor.WindowLen/Parameters->SymbolLen;
+         size_t DecodeMargin=Parameters->SearchMargin*Parameters->CarrierSepar;
+         size_t First=Parameters->FirstCarrier-DecodeMargin;
+         size_t Width=(Parameters->Carriers-1)*Parameters->CarrierSepar+1+2*DecodeMargin;
+         InputProcessor.BandStart = First>Parameters->CarrierSepar ? (First-Parameters->CarrierSepar)*Scale:0;
+         InputProcessor.BandStop=(First+Width+Parameters->CarrierSepar)*Scale;
+         if(Parameters->RxBaseband) PresetBaseband(First,Width,Scale); }
        if(InputProcessor.Preset()<0) goto Error;
 
-       if(InputBuffer.EnsureSpace(InputProcessor.WindowLen+2048)<0) goto Error;
+       if(InputBuffer.Preset(2*InputProcessor.WindowLen)<0) goto Error;
+       InputFill=0;
 
        if(Demodulator.Preset(Parameters)<0) goto Error;
+       if(ReallocArray(&ZeroSlice,Demodulator.SliceLen())<0) goto Error;
+       ClearArray(ZeroSlice,Demodulator.SliceLen());
+       if(FreqSearch.Preset(Parameters)<0) goto Error;
        if(Synchronizer.Preset(Parameters)<0) goto Error;
+       SyncBase=NominalSyncBase();
+       Detector.Preset(Parameters);
+       SyncActive=(Parameters->RxDetectThreshold<=0);
+       Parked=0;
        if(Decoder.Preset(Parameters)<0) goto Error;
 
-       Output.Len=1024;
+       EarlyLen=2*(Parameters->RxSyncIntegLen+2);
+       if(ReallocArray(&EarlyStart,EarlyLen)<0) goto Error;
+
+       Output.Len=1024;                              // with early decoding: room for all the early blocks
+       if(Parameters->RxEarlyDecode)                 // and their confirm/cancel entries, see WriteOutputBlock()
+       { size_t Need=2*(EarlyLen+1)*Parameters->BitsPerSymbol;
+         if(Output.Len<Need) Output.Len=Need; }
        if(Output.Preset()<0) goto Error;
+       if(Parameters->RxEarlyDecode)
+       { OutputFlag.Len=Output.Len;
+         if(OutputFlag.Preset()<0) goto Error; }
+
+       SliceCount=0;
+       Stats.Reset();
+       EarlyHead=0; EarlyCount=0;
+
+       if(StartPipeline()<0) goto Error;
 
        return 0;
 
        Error: Free(); return -1; }
 
    void Reset(void)
-     { RateConverter.Reset();
-       InputBuffer.Clear();
+     { Sync();
+       InputRateConverter.Reset();
+       InputBuffer.Reset();
+       InputFill=0;
        InputProcessor.Reset();
        Demodulator.Reset();
+       FreqSearch.Reset();
        Synchronizer.Reset();
-       Output.Reset(); }
+       SyncBase=NominalSyncBase();
+       Detector.Reset();
+       SyncActive=(Parameters->RxDetectThreshold<=0);
+       Parked=0;
+       Output.Reset();
+       if(Parameters->RxEarlyDecode) OutputFlag.Reset();
+       SliceCount=0;
+       EarlyHead=0; EarlyCount=0;
+       StoreStatus(); }
+
+   // save the complete receiver state into a binary file (for a blob in memory: open_memstream()),
+   // a receiver preset with the same parameters continues from it after LoadState(),
+   // returns -1 when the write fails
+   int SaveState(FILE *File)
+     { Sync();
+       return StateIO(File,0); }
+
+   // load the state written by SaveState(), returns -1 when the read fails
+   // or -2 when the state is of other parameters, another format version, word size or byte order:
+   // then the receiver is Reset()
+   int LoadState(FILE *File)
+     { Sync();
+       int Error=StateIO(File,1);
+       if(Error<0) Reset();
+       else StoreStatus();
+       return Error; }
 
    Type SyncSNR(void)
-   { return Synchronizer.FEC_SNR(); }
+   { return LoadStatus(Status.SyncSNR); }
 
    Type FrequencyOffset(void)
-   { return Synchronizer.FrequencyOffset(); }
+   { return LoadStatus(Status.FrequencyOffset); }
 
    Type FrequencyDrift(void)
-   { return Synchronizer.FrequencyDriftRate(); }
+   { return LoadStatus(Status.FrequencyDrift); }
 
    Type TimeDrift(void)
-   { return Synchronizer.TimeDriftRate(); }
+   { return LoadStatus(Status.TimeDrift); }
 
    Type InputSNRdB(void)
-   { return Decoder.InputSNRdB(); }
+   { return LoadStatus(Status.InputSNRdB); }
+
+   int StableLock(void)
+   { return __atomic_load_n(&Status.StableLock,__ATOMIC_RELAXED); }
+
+   // (when pipelined, the above lag the decoder stage by up to one symbol)
 
    // process an audio batch: first the input processor, then the demodulator
    template <class InpType>
     int Process(InpType *Input, size_t InputLen)
-     { if(RateConverter.Process(Input, InputLen, InputBuffer)<0) return -1;
-       ProcessInputBuffer();
+     { if(Stage[0]==0) return ProcessInput(Input,InputLen);
+       while(InputLen)                               // the input stage runs on a background thread
+       { size_t Len=StageInput[0].SlotLen;
+         if(Len>InputLen) Len=InputLen;
+         Type *Slot=StageInput[0].WriteSlot();
+         size_t Idx;
+         for(Idx=0; Idx<Len; Idx++)
+           Slot[Idx]=Input[Idx];
+         StageInput[0].Commit(Len);
+         Input+=Len; InputLen-=Len; }
+       return 0; }
+
+   // push the (partial) input through with zeros and wait until all is processed:
+   // Fast => only until the last block which can still hold the signal is decoded,
+   // and most of it without the input processor and the demodulator FFTs
+   void Flush(int Fast=1)
+     { if(Stage[0]) Send(0,StageFlush,Fast);
+               else FlushInput(Fast);
+       if(Stage[2]) Send(FirstStage(1),StageDrain,Fast);
+               else DrainSpectra(Fast);
+       Sync(); }
+
+   // get one final character from the output buffer (skip the provisional ones)
+   int GetChar(uint8_t &Char)
+     { if(Parameters->RxEarlyDecode==0) return Output.Read(Char);
+       uint8_t Flag=CharFinal;
+       while(GetChar(Char,Flag))
+         if((Flag==CharFinal)||(Flag==CharConfirm)) return 1;
+       return 0; }
+
+   // get one character with its flag: CharFinal, CharProvisional, CharConfirm or CharCancel
+   int GetChar(uint8_t &Char, uint8_t &Flag)
+     { if(Parameters->RxEarlyDecode==0) { Flag=CharFinal; return Output.Read(Char); }
+       if(Output.Read(Char)==0) return 0;
+       if(OutputFlag.Read(Flag)==0) Flag=CharFinal;       // the flag was written before the character
+       return 1; }
+
+   // get up to MaxLen final characters, return how many
+   size_t GetChars(uint8_t *Chars, size_t MaxLen)
+     { if(Parameters->RxEarlyDecode==0) return Output.Read(Chars,MaxLen);
+       size_t Len;
+       for(Len=0; Len<MaxLen; Len++)
+         if(GetChar(Chars[Len])==0) break;
+       return Len; }
+
+   // process the output of an input processor shared with other receivers (MFSK_MultiReceiver):
+   // Len samples, a multiple of SymbolSepar, at the internal sample rate (not for the pipelined mode)
+   void ProcessShared(Type *Input, size_t Len)
+     { size_t Idx;
+       for(Idx=0; Idx<Len; Idx+=Parameters->SymbolSepar)
+         ProcessSymbol(Input+Idx); }
+
+   // the fast Flush() after the shared input processor was flushed
+   void FlushShared(void)
+     { DrainSpectra(1); }
+
+   // park the synchronizer (the demodulator keeps the history up to date)
+   // or wake it up with a replay of the history, thus no signal is lost meanwhile
+   void Park(int On)
+     { if(On==Parked) return;
+       Parked=On;
+       if(Parked) { while(EarlyCount) GiveUpEarlyBlock(); }
+       else if(SyncActive) WakeUpSync(-1); }
+
+   int IsParked(void)
+     { return Parked; }
+
+  private:
+
+   // the input stage: rate converter, then the input processor
+   template <class InpType>
+    int ProcessInput(InpType *Input, size_t InputLen)
+     { while(InputLen)
+       { size_t Space=InputBuffer.Len-InputFill;     // the rate converter output fits into what is free
+         size_t Chunk=(size_t)floor((Space-3)/InputRateConverter.OutputRate);
+         if(Chunk<1) Chunk=1;
+         if(Chunk>InputLen) Chunk=InputLen;
+         uint64_t Start=StatsTime();
+         int OutLen=InputRateConverter.Process(Input, Chunk, InputBuffer.Window(InputFill));
+         AddStats(Stats.RateConverter,Start);
+         InputBuffer.Mirror(InputFill,OutLen);
+         InputFill+=OutLen;
+         Input+=Chunk; InputLen-=Chunk;
+         ProcessInputBuffer(); }
 	   return 0; }
 
-   void Flush(void)
+   void FlushInput(int Fast)
      { ProcessInputBuffer();
-       size_t Idx;
 
-	   for(Idx=InputBuffer.Len; Idx<InputProcessor.WindowLen; Idx++)
-	     InputBuffer[Idx]=0;
-	   InputBuffer.Len=InputProcessor.WindowLen;
+       InputZeros(InputProcessor.WindowLen-InputFill);
        ProcessInputBuffer();
 
-	   for(Idx=0; Idx<InputProcessor.WindowLen; Idx++)
-	     InputBuffer[Idx]=0;
-       size_t FlushLen=Parameters->SymbolSepar*Parameters->SymbolsPerBlock*Parameters->RxSyncIntegLen*2;
+       size_t Idx;
+       size_t FlushLen = Fast ? InputProcessor.WindowLen       // one window of zeros clears all the taps
+                              : Parameters->SymbolSepar*Parameters->SymbolsPerBlock*Parameters->RxSyncIntegLen*2;
        for(Idx=0; Idx<FlushLen; Idx+=InputProcessor.WindowLen)
-       { InputBuffer.Len=InputProcessor.WindowLen;
+       { InputZeros(InputProcessor.WindowLen);
 	     ProcessInputBuffer(); }
 	 }
 
-   // get one character from the output buffer
-   int GetChar(uint8_t &Char)
-     { return Output.Read(Char); }
+   // the rest of a fast flush: with only zeros in their taps the input processor and the demodulator
+   // would give zero slices, thus these go straight into the history, until the latest block
+   // the decoder may pick (with its time search) starts after the signal,
+   // then the early blocks which were not confirmed are given up
+   void DrainSpectra(int Fast)
+     { if(Fast) DrainZeros();
+       while(EarlyCount) GiveUpEarlyBlock(); }
+
+   void DrainZeros(void)
+     { size_t SpectraPerBlock=Parameters->SpectraPerBlock;
+       size_t SpectraPerSymbol=Parameters->SpectraPerSymbol;
+       size_t DrainLen=(Parameters->RxSyncIntegLen+1)*SpectraPerBlock+SpectraPerBlock/2+3;
+       size_t Idx,Slice;
+       for(Idx=0; Idx<DrainLen; Idx+=SpectraPerSymbol)
+       { for(Slice=0; Slice<SpectraPerSymbol; Slice++)
+           Demodulator.StoreSlice(ZeroSlice);
+         ProcessSpectra(); }
+     }
 
-  private:
+   // start the background threads for the stages as set by RxPipeline[]
+   int StartPipeline(void)
+     { size_t Idx;
+       for(Idx=0; Idx<3; Idx++)
+         Stage[Idx]=Parameters->RxPipeline[Idx];
+       if(Stage[2]==0) return 0;
+
+       size_t SymbolsPerWindow=InputProcessor.WindowLen/Parameters->SymbolSepar;
+       size_t SlotLen[3];
+       SlotLen[0]=4096;
+       SlotLen[1]=InputProcessor.OutputLen()*(InputProcessor.BasebandLen ? 2:1);
+       SlotLen[2]=SymbolsPerWindow*Parameters->SpectraPerSymbol*Demodulator.SliceLen();
+       for(Idx=0; Idx<3; Idx++)
+       { if(Stage[Idx]==(Idx ? Stage[Idx-1]:0)) continue;
+         if(StageInput[Idx].Preset(4,SlotLen[Idx])<0) goto Error; }
+
+       if(sem_init(&Synced,0,0)<0) goto Error;
+       for(Threads=0; Threads<Stage[2]; Threads++)
+       { Arg[Threads].Receiver=this;
+         Arg[Threads].Thread=Threads+1;
+         if(pthread_create(Thread+Threads,0,StageLoop,Arg+Threads)) goto Error; }
+       return 0;
+
+       Error: StopPipeline(); return -1; }
+
+   void StopPipeline(void)
+     { if(Threads)
+       { Send(FirstStage(1),StageStop);
+         for( ; Threads; Threads--)
+           pthread_join(Thread[Threads-1],0);
+         sem_destroy(&Synced); }
+       size_t Idx;
+       for(Idx=0; Idx<3; Idx++)
+         StageInput[Idx].Free();
+       Stage[0]=Stage[1]=Stage[2]=0; }
+
+   // the first and the last stage of a thread
+   size_t FirstStage(size_t Thread)
+     { size_t Idx;
+       for(Idx=0; Idx<3; Idx++)
+         if(Stage[Idx]==Thread) break;
+       return Idx; }
+
+   size_t LastStage(size_t Thread)
+     { size_t Idx;
+       for(Idx=3; Idx>0; Idx--)
+         if(Stage[Idx-1]==Thread) break;
+       return Idx-1; }
+
+   // send a control message (empty slot, the length may carry an argument) to a stage
+   void Send(size_t ToStage, int Tag, size_t Arg=0)
+     { StageInput[ToStage].WriteSlot();
+       StageInput[ToStage].Commit(Arg,Tag); }
+
+   // wait until the background stages processed all that was given to them
+   void Sync(void)
+     { if(Threads==0) return;
+       Send(FirstStage(1),StageSync);
+       while(sem_wait(&Synced)<0)
+         if(errno!=EINTR) break; }
+
+   static void *StageLoop(void *Ptr)
+     { ThreadArg *Arg=(ThreadArg *)Ptr;
+       Arg->Receiver->RunThread(Arg->Thread);
+       return 0; }
+
+   // a background thread: take the slots for its first stage until told to stop
+   void RunThread(size_t Thread)
+     { size_t First=FirstStage(Thread);
+       size_t Next=LastStage(Thread)+1;
+       for( ; ; )
+       { size_t Len; int Tag;
+         Type *Slot=StageInput[First].ReadSlot(Len,Tag);
+         if(Tag==StageData)
+         { if(First==0) ProcessInput(Slot,Len);
+           else if(First==1) ProcessWindow(Slot);
+           else ProcessSlices(Slot,Len); }
+         else if(Tag==StageFlush)
+           FlushInput(Len);
+         StageInput[First].Release();
+         if((Tag!=StageData)&&(Tag!=StageFlush))     // pass on to the next thread or act on it
+         { if(Next<3) Send(Next,Tag,Len);
+           else if(Tag==StageDrain) DrainSpectra(Len);
+           else if(Tag==StageSync) sem_post(&Synced); }
+         if(Tag==StageStop) break; }
+     }
+
+   // choose the decimation for the complex baseband handoff: the smallest demodulator FFT
+   // which holds the decode width [First..First+Width) plus two carriers on each side
+   void PresetBaseband(size_t First, size_t Width, size_t Scale)
+     { size_t SymbolLen=Parameters->SymbolLen;
+       size_t SliceSepar=Parameters->SymbolSepar/Parameters->SpectraPerSymbol;
+       size_t Guard=2*Parameters->CarrierSepar;
+       size_t Shift = First>Guard ? First-Guard:0;
+       size_t Need=First+Width+Guard-Shift;
+       size_t Decimate=1;
+       while( ((SymbolLen/(2*Decimate))>=Need) && ((SliceSepar%(2*Decimate))==0) ) Decimate*=2;
+       size_t BasebandLen=SymbolLen/Decimate;
+       if((Shift+BasebandLen)>(SymbolLen/2)) Shift=(SymbolLen/2)-BasebandLen;
+       if(Decimate<2) { Decimate=1; Shift=0; BasebandLen=0; } // no gain: stay with the real signal
+       Demodulator.Decimate=Decimate;
+       Demodulator.BasebandShift=Shift;
+       InputProcessor.BasebandStart=Shift*Scale;
+       InputProcessor.BasebandLen=BasebandLen*Scale; }
+
+   // take the status snapshot for the getters
+   void StoreStatus(void)
+     { StoreStatus(Status.SyncSNR,Synchronizer.FEC_SNR());
+       StoreStatus(Status.FrequencyOffset,Synchronizer.FrequencyOffset()
+                   +((int)SyncBase-(int)NominalSyncBase())*Parameters->FFTbinBandwidth());
+       StoreStatus(Status.FrequencyDrift,Synchronizer.FrequencyDriftRate());
+       StoreStatus(Status.TimeDrift,Synchronizer.TimeDriftRate());
+       StoreStatus(Status.InputSNRdB,Decoder.InputSNRdB());
+       __atomic_store_n(&Status.StableLock,Synchronizer.StableLock,__ATOMIC_RELAXED); }
+
+   static void StoreStatus(Type &Field, Type Value)
+     { __atomic_store(&Field,&Value,__ATOMIC_RELAXED); }
+
+   static Type LoadStatus(Type &Field)
+     { Type Value; __atomic_load(&Field,&Value,__ATOMIC_RELAXED); return Value; }
+
+   // the statistics cost only a test when not collected
+   uint64_t StatsTime(void)
+     { return Parameters->RxStats ? MFSK_NanoTime():0; }
+
+   void AddStats(MFSK_StageStats &Stage, uint64_t Start)
+     { if(Parameters->RxStats) Stage.Add(MFSK_NanoTime()-Start); }
+
+   MFSK_ReceiverStats *StatsPtr(void)
+     { return Parameters->RxStats ? &Stats:0; }
+
+   // synchronizer window start when centered on the nominal frequency
+   size_t NominalSyncBase(void)
+     { return (Parameters->SearchMargin-Parameters->RxSyncMargin)*Parameters->CarrierSepar; }
+
+   // save (Load=0) or load (Load=1) the state of all the stages (the pipeline must be synced):
+   // the format (with the word sizes and the byte order) and the parameters which shape the state go first,
+   // of the buffers only what is still in use is saved
+   int StateIO(FILE *File, int Load)
+     { uint32_t Format[] = { StateMagic, StateVersion, StateByteOrder, sizeof(size_t), sizeof(Type) };
+       const size_t FormatLen=sizeof(Format)/sizeof(uint32_t);
+       uint32_t SavedFormat[FormatLen];
+       CopyArray(SavedFormat,Format,FormatLen);
+       if(StateArray(File,Load,SavedFormat,FormatLen)<0) return -1;
+       if(memcmp(SavedFormat,Format,sizeof(Format))) return -2;
+
+       size_t Header[] = { Parameters->BitsPerSymbol, Parameters->Bandwidth, Parameters->SampleRate,
+                           Parameters->FirstCarrier, Parameters->SearchMargin, Parameters->RxSyncMargin,
+                           Parameters->RxSyncIntegLen, Parameters->RxSyncHardPass, Parameters->RxSyncSoftBits,
+                           Parameters->RxCompactHistory, Parameters->RxCarrierMajor, Parameters->RxBandLimit,
+                           Parameters->RxBaseband, Parameters->RxEarlyDecode };
+       const size_t HeaderLen=sizeof(Header)/sizeof(size_t);
+       size_t Saved[HeaderLen];
+       CopyArray(Saved,Header,HeaderLen);
+       if(StateArray(File,Load,Saved,HeaderLen)<0) return -1;
+       if(memcmp(Saved,Header,sizeof(Header))) return -2;
+
+       if(InputRateConverter.StateIO(File,Load)<0) return -1;
+       if(StateArray(File,Load,&InputFill,1)<0) return -1;
+       if(InputBuffer.StateIO(File,Load,InputFill)<0) return -1; // the samples waiting
+       if(InputProcessor.StateIO(File,Load)<0) return -1;
+       if(StateArray(File,Load,&SliceCount,1)<0) return -1;
+       if(Demodulator.StateIO(File,Load,SliceCount)<0) return -1; // the history since the start
+       if(FreqSearch.StateIO(File,Load)<0) return -1;
+       if(Synchronizer.StateIO(File,Load)<0) return -1;
+       if(StateArray(File,Load,&SyncBase,1)<0) return -1;
+       if(Detector.StateIO(File,Load)<0) return -1;
+       if(StateArray(File,Load,&SyncActive,1)<0) return -1;
+       if(StateArray(File,Load,&Parked,1)<0) return -1;
+       if(Output.StateIO(File,Load)<0) return -1;
+       if(Parameters->RxEarlyDecode)
+       { if(OutputFlag.StateIO(File,Load)<0) return -1; }
+       if(StateArray(File,Load,EarlyStart,EarlyLen)<0) return -1;
+       if(StateArray(File,Load,&EarlyHead,1)<0) return -1;
+       if(StateArray(File,Load,&EarlyCount,1)<0) return -1;
+       if((SyncBase>2*NominalSyncBase())
+        ||(EarlyHead>=EarlyLen)||(EarlyCount>EarlyLen)) return -1;
+       return 0; }
+
+   // once per FEC block: move the synchronizer window onto the coarse search best candidate
+   // and let the synchronizer catch up with the history up to (not including) the given slice
+   void MoveSyncWindow(int HistOfs)
+     { if(Synchronizer.StableLock) return;                   // never leave a locked signal
+       if(FreqSearch.BestCount<2) return;                    // the candidate must stay for two blocks
+       if(FreqSearch.Significance(FreqSearch.BestOffset)<FreqSearch.Threshold) return; // and stand out of the noise
+       size_t SyncMargin=Parameters->RxSyncMargin*Parameters->CarrierSepar;
+       size_t Center=SyncBase+SyncMargin;
+       size_t Best=FreqSearch.BestOffset;
+       size_t Dist = Best>Center ? Best-Center : Center-Best;
+       if(2*Dist<=SyncMargin) return;                        // still well within the window
+       size_t MaxBase=2*NominalSyncBase();
+       size_t NewBase = Best>SyncMargin ? Best-SyncMargin : 0;
+       if(NewBase>MaxBase) NewBase=MaxBase;
+       if(NewBase==SyncBase) return;                         // clamped: the window can not move further
+       SyncBase=NewBase;
+       if(SyncActive&&(!Parked)) ReplaySync(HistOfs);
+                            else Synchronizer.Reset(); }
+
+   // append zeros to the input buffer
+   void InputZeros(size_t Len)
+     { ClearArray(InputBuffer.Window(InputFill),Len);
+       InputBuffer.Mirror(InputFill,Len);
+       InputFill+=Len; }
 
    // process the input buffer: first the input processor, then the demodulator
     void ProcessInputBuffer(void)
-     { while(InputBuffer.Len>=InputProcessor.WindowLen)
-	   { InputProcessor.Process(InputBuffer.Elem);
-         InputBuffer.Delete(0,InputProcessor.WindowLen);
-         size_t Idx;
-         for(Idx=0; Idx<InputProcessor.WindowLen; Idx+=Parameters->SymbolSepar )
-           ProcessSymbol(InputProcessor.Output+Idx);
+     { while(InputFill>=InputProcessor.WindowLen)
+	   { uint64_t Start=StatsTime();
+         InputProcessor.Process(InputBuffer.Window());
+         AddStats(Stats.InputProcessor,Start);
+         InputBuffer+=InputProcessor.WindowLen;
+         InputFill-=InputProcessor.WindowLen;
+         Type *Window = InputProcessor.BasebandLen ? (Type *)InputProcessor.BasebandOutput:InputProcessor.Output;
+         if(Stage[1]==Stage[0])
+         { ProcessWindow(Window); continue; }
+         size_t Len=StageInput[1].SlotLen;             // the demodulator runs on another thread
+         CopyArray(StageInput[1].WriteSlot(),Window,Len);
+         StageInput[1].Commit(Len);
        }
      }
 
+   // the demodulator stage: one input processor output window
+   void ProcessWindow(Type *Window)
+     { Type *Slot=0;
+       if(Stage[2]!=Stage[1])                          // the slices go to the decoder thread
+       { Slot=StageInput[2].WriteSlot();
+         Demodulator.SliceOutput=Slot; }
+       size_t Idx;
+       if(InputProcessor.BasebandLen)
+       { Cmpx<Type> *Baseband=(Cmpx<Type> *)Window;
+         for(Idx=0; Idx<InputProcessor.BasebandLen; Idx+=Demodulator.InputLen )
+           ProcessSymbol(Baseband+Idx); }
+       else
+       { for(Idx=0; Idx<InputProcessor.WindowLen; Idx+=Parameters->SymbolSepar )
+           ProcessSymbol(Window+Idx); }
+       if(Slot)
+       { StageInput[2].Commit(Demodulator.SliceOutput-Slot);
+         Demodulator.SliceOutput=0; }
+     }
+
+   // the decoder stage: the slices (energies) of the demodulator output window
+   void ProcessSlices(Type *Slices, size_t Len)
+     { size_t SliceLen=Demodulator.SliceLen();
+       size_t Idx,Slice;
+       for(Idx=0; Idx<Len; )
+       { for(Slice=0; Slice<Parameters->SpectraPerSymbol; Slice++, Idx+=SliceLen)
+           Demodulator.StoreSlice(Slices+Idx);
+         ProcessSpectra(); }
+     }
+
    // process (through the demodulator) an audio batch corresponding to one symbol
    // (demodulator always works with audio batches corresponding to one symbol period)
    template <class InpType>
     void ProcessSymbol(InpType *Input)
-   { size_t SpectraPerSymbol=Parameters->SpectraPerSymbol;
+   { uint64_t Start=StatsTime();
      Demodulator.Process(Input);
+     AddStats(Stats.Demodulator,Start);
+     if(Demodulator.SliceOutput==0) ProcessSpectra(); }
+
+   // the slices of the last symbol through the frequency search, pre-detector, synchronizer and decoder
+    void ProcessSpectra(void)
+   { size_t SpectraPerSymbol=Parameters->SpectraPerSymbol;
+    SliceCount+=SpectraPerSymbol;
     int HistOfs;
     for(HistOfs=(-SpectraPerSymbol); HistOfs<0; HistOfs++)
     { Type *Spectra = Demodulator.HistoryPtr(HistOfs);
-      Synchronizer.Process(Spectra);
+      int Signal=0;
+      if((Parameters->SearchMargin>Parameters->RxSyncMargin)||(Parameters->RxDetectThreshold>0))
+      { uint64_t Start=StatsTime();
+        int Update=FreqSearch.Process(Spectra);
+        AddStats(Stats.FreqSearch,Start);
+        if(Update)
+        { if(Parameters->SearchMargin>Parameters->RxSyncMargin) MoveSyncWindow(HistOfs);
+          if(Parameters->RxDetectThreshold>0) Signal=Detector.Process(FreqSearch); }
+      }
+      if(Parameters->RxDetectThreshold>0)
+      { if(!SyncActive)
+        { if(Signal && !Parked) WakeUpSync(HistOfs);
+          continue; }
+        if((Detector.IdleLen>(Parameters->RxSyncIntegLen+1))&&(!Synchronizer.StableLock))
+        { SyncActive=0; continue; }          // no signal in the whole history and no lock: the synchronizer can sleep
+      }
+      if(Parked) continue;
+      ProcessSlice(HistOfs);
+    }
+    StoreStatus();
+   }
+
+   // wake up the synchronizer: replay the whole history up to the given slice, thus the integrators
+   // see the signal from its start (when detected within RxSyncIntegLen+1 blocks) and lock
+   // as if they had run all the time: the first FEC block is not lost
+   void WakeUpSync(int HistOfs)
+     { SyncActive=1;
+       ReplaySync(HistOfs+1); }
+
+   // restart the synchronizer on the whole history up to (not including) the given slice
+   void ReplaySync(int HistOfs)
+     { Synchronizer.Reset();
+       int Ofs=(-(int)((Parameters->RxSyncIntegLen+2)*Parameters->SpectraPerBlock));
+       for( ; Ofs<HistOfs; Ofs++)
+         ProcessSlice(Ofs); }
+
+   // the coarse pass found a new signal candidate at the given slice: restart the synchronizer
+   // on the whole history with the candidates held, so the soft search integrates it from the start
+   // (the coarse pass takes a few FEC blocks to find a signal, thus the history is longer with it).
+   // The replay starts whole FEC blocks back, thus the time-phases of the candidates stay valid
+   void ReplayCoarse(int HistOfs)
+     { size_t SpectraPerBlock=Parameters->SpectraPerBlock;
+       int Ofs=HistOfs-(int)((Demodulator.HistorySlices()/SpectraPerBlock-1)*SpectraPerBlock);
+       Synchronizer.CoarseHold=1;
+       Synchronizer.Reset();
+       for( ; Ofs<=HistOfs; Ofs++)
+         ProcessSlice(Ofs);
+       Synchronizer.CoarseHold=0; }
+
+   // synchronize on the given slice of the spectra history and decode a FEC block when in the middle of it
+   void ProcessSlice(int HistOfs)
+    { Type *Spectra = Demodulator.HistoryPtr(HistOfs);
+      uint64_t Start=StatsTime();
+      Synchronizer.Process(Spectra+SyncBase);
+      AddStats(Stats.Synchronizer,Start);
+      if(Synchronizer.CoarseNew) { ReplayCoarse(HistOfs); return; }
       size_t SpectraPerBlock=Parameters->SpectraPerBlock;
       if(Synchronizer.DecodeReference==0)
       { 
@@ -2430,38 +4470,606 @@ template <class Type=float>
 */
         if(Synchronizer.StableLock)
         { int TimeOffset = (HistOfs-((Parameters->RxSyncIntegLen+1)*SpectraPerBlock+SpectraPerBlock/2-1));
-          int FreqOffset = Synchronizer.SyncBestFreqOffset;
-
-          Type BestSignal=0;
-          int BestTime=0;
-          int BestFreq=0;
-          int FreqSearch;
-          for(FreqSearch=(-1); FreqSearch<=1; FreqSearch++)
-          { int TimeSearch;
-            for(TimeSearch=(-2); TimeSearch<=2; TimeSearch++)
-	        { int Error=Demodulator.PickBlock(Decoder.Input, TimeOffset+TimeSearch,FreqOffset+FreqSearch);
-              if(Error<0) continue;
-		      Decoder.Process(8);
-              // printf("%+2d/%+2d: ", FreqSearch, TimeSearch);
-			  // Decoder.PrintSNR();
-              Type Signal=Decoder.Input_SignalEnergy;
-              if(Signal>BestSignal)
-			  { BestSignal=Signal; BestFreq=FreqSearch; BestTime=TimeSearch; }
-			}
-          }
-
-	      Demodulator.PickBlock(Decoder.Input, TimeOffset+BestTime,FreqOffset+BestFreq);
-		  Decoder.Process(32);
-          // printf("Best: %+2d/%+2d: ", BestFreq, BestTime);
-	      // Decoder.PrintSNR();
-          Decoder.WriteOutputBlock(Output);
+          int FreqOffset = SyncBase+Synchronizer.SyncBestFreqOffset;
+
+          int BestTime=TimeOffset;
+          if(MFSK_DecodeBlock(Demodulator,Decoder,BestTime,FreqOffset,StatsPtr())>=0)
+          { if(Parameters->RxEarlyDecode) ConfirmBlock(SliceCount+BestTime);
+                                     else Decoder.WriteOutputBlock(Output); }
+
+          if(Parameters->RxEarlyDecode)                  // the latest complete block with the same lock
+          { BestTime=TimeOffset+Parameters->RxSyncIntegLen*SpectraPerBlock;
+            if(MFSK_DecodeBlock(Demodulator,Decoder,BestTime,FreqOffset,StatsPtr())>=0) EarlyBlock(SliceCount+BestTime); }
 
 		}
 
 	  }
     }
 
-   }
+   // the delayed decode of the block starting at Start [slices]: confirms the early block
+   // within half a block from it, the older early blocks are given up
+   void ConfirmBlock(size_t Start)
+     { long Tolerance=Parameters->SpectraPerBlock/2;
+       while(EarlyCount)
+       { long Diff=(long)(EarlyStart[EarlyHead]-Start);
+         if(Diff>=(-Tolerance)) break;
+         GiveUpEarlyBlock(); }
+       if(EarlyCount && ((long)(EarlyStart[EarlyHead]-Start)<=Tolerance))
+       { DropEarlyBlock();
+         WriteOutputBlock(Decoder.OutputBlock,CharConfirm); }
+       else WriteOutputBlock(Decoder.OutputBlock,CharFinal); }
+
+   // the early decode of the block starting at Start [slices]: provisional characters
+   void EarlyBlock(size_t Start)
+     { if(EarlyCount>=EarlyLen) GiveUpEarlyBlock();
+       if(WriteOutputBlock(Decoder.OutputBlock,CharProvisional)<0) return; // no room: the delayed decode gives the final block
+       size_t Idx=EarlyHead+EarlyCount; if(Idx>=EarlyLen) Idx-=EarlyLen;
+       EarlyStart[Idx]=Start; EarlyCount+=1; }
+
+   // the oldest early block will not be confirmed: withdraw its characters
+   void GiveUpEarlyBlock(void)
+     { uint8_t Zero[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+       DropEarlyBlock();
+       WriteOutputBlock(Zero,CharCancel); }
+
+   void DropEarlyBlock(void)
+     { EarlyHead+=1; if(EarlyHead>=EarlyLen) EarlyHead=0;
+       EarlyCount-=1; }
+
+   // characters with their flag: the flags go first, so the reader always finds them.
+   // Room for one block per (not yet dropped) early block is kept free for its confirm/cancel entries,
+   // thus when the reader lags, the final and provisional blocks are dropped (returns -1), never these
+   int WriteOutputBlock(uint8_t *Block, uint8_t Flag)
+     { size_t Len=Parameters->BitsPerSymbol;
+       size_t Need=Len*(EarlyCount+1);
+       if(Flag==CharProvisional) Need+=Len;          // and the room for its own confirm/cancel
+       if((Output.WriteReady()<Need)||(OutputFlag.WriteReady()<Need)) return -1;
+       size_t Idx;
+       for(Idx=0; Idx<Len; Idx++)
+         OutputFlag.Write(Flag);
+       Output.Write(Block,Len);
+       return 0; }
+
+} ;
+
+// =====================================================================
+// Multi-mode receiver: for when the mode of the station is not known.
+// The rate converter and the input processor do not depend on the mode,
+// thus they are shared, while every mode (hypothesis) gets a receiver of its own
+// for the demodulator, synchronizer and decoder. The modes are spread over worker threads
+// and the best locking one is reported.
+
+template <class Type=float>
+ class MFSK_MultiReceiver
+{ public:
+
+   static const size_t MaxModes = 8;
+
+   size_t Workers;                           // threads sharing the modes (including the caller)
+   int Prune;                                // park the other modes while one has a stable lock
+
+  private:
+
+   size_t Modes;                             // number of modes
+   MFSK_Parameters<Type> Parameters[MaxModes]; // the modes, as the receivers run them
+   MFSK_Receiver<Type> Receiver[MaxModes];   // demodulator, synchronizer and decoder for every mode
+
+   RateConverter<Type> InputRateConverter;
+   MirrorBuffer<Type> InputBuffer;           // rate converter output, read one input processor window at a time
+   size_t InputFill;                         // samples waiting in InputBuffer (from its pointer on)
+   MFSK_InputProcessor<Type> InputProcessor; // equalizes the input spectrum (shared by all the modes)
+
+   WorkerPool Pool;                          // threads sharing the modes
+
+  public:
+
+   MFSK_MultiReceiver()
+     { Init();
+       Default(); }
+
+   ~MFSK_MultiReceiver()
+     { Free(); }
+
+   void Init(void)
+     { Modes=0; }
+
+   void Default(void)
+     { Workers=1;
+       Prune=1; }
+
+   void Free(void)
+     { Pool.Free();
+       size_t Mode;
+       for(Mode=0; Mode<MaxModes; Mode++)
+         Receiver[Mode].Free();
+       InputRateConverter.Free();
+       InputBuffer.Free();
+       InputProcessor.Free(); }
+
+   // resize internal arrays according the (preset) parameters of the modes:
+   // these must share the sample rates
+   int Preset(MFSK_Parameters<Type> *NewParameters, size_t NewModes)
+     { Free();
+       if((NewModes<1)||(NewModes>MaxModes)) return -1;
+       Modes=NewModes;
+
+       size_t Mode;
+       size_t MaxSymbolSepar=0;
+       for(Mode=0; Mode<Modes; Mode++)
+       { Parameters[Mode]=NewParameters[Mode];
+         Parameters[Mode].RxBandLimit=0;     // the input processor looks at the whole band
+         Parameters[Mode].RxBaseband=0;
+         Parameters[Mode].RxPipeline[0]=Parameters[Mode].RxPipeline[1]=Parameters[Mode].RxPipeline[2]=0;
+         if( (Parameters[Mode].SampleRate!=Parameters[0].SampleRate)
+           ||(Parameters[Mode].InputSampleRate!=Parameters[0].InputSampleRate) ) goto Error;
+         if(Parameters[Mode].SymbolSepar>MaxSymbolSepar) MaxSymbolSepar=Parameters[Mode].SymbolSepar; }
+
+       InputRateConverter.OutputRate=Parameters[0].SampleRate/Parameters[0].InputSampleRate;
+       if(InputRateConverter.Preset()<0) goto Error;
+
+       InputProcessor.WindowLen=32*MaxSymbolSepar;
+       if(InputProcessor.Preset()<0) goto Error;
+
+       if(InputBuffer.Preset(2*InputProcessor.WindowLen)<0) goto Error;
+       InputFill=0;
+
+       for(Mode=0; Mode<Modes; Mode++)
+       { if(InputProcessor.WindowLen%Parameters[Mode].SymbolSepar) goto Error;
+         if(Receiver[Mode].Preset(Parameters+Mode)<0) goto Error; }
+
+       Pool.Workers = Workers<Modes ? Workers:Modes;
+       if(Pool.Preset()<0) goto Error;
+
+       return 0;
+
+       Error: Free(); Modes=0; return -1; }
+
+   void Reset(void)
+     { InputRateConverter.Reset();
+       InputBuffer.Reset();
+       InputFill=0;
+       InputProcessor.Reset();
+       size_t Mode;
+       for(Mode=0; Mode<Modes; Mode++)
+         Receiver[Mode].Reset(); }
+
+   // process an audio batch
+   template <class InpType>
+    int Process(InpType *Input, size_t InputLen)
+     { while(InputLen)
+       { size_t Space=InputBuffer.Len-InputFill;     // the rate converter output fits into what is free
+         size_t Chunk=(size_t)floor((Space-3)/InputRateConverter.OutputRate);
+         if(Chunk<1) Chunk=1;
+         if(Chunk>InputLen) Chunk=InputLen;
+         int OutLen=InputRateConverter.Process(Input, Chunk, InputBuffer.Window(InputFill));
+         InputBuffer.Mirror(InputFill,OutLen);
+         InputFill+=OutLen;
+         Input+=Chunk; InputLen-=Chunk;
+         ProcessInputBuffer(); }
+       return 0; }
+
+   // push the (partial) input through with zeros until the last blocks are decoded
+   // (as the fast Flush() of the receiver)
+   void Flush(void)
+     { ProcessInputBuffer();
+       InputZeros(InputProcessor.WindowLen-InputFill);
+       ProcessInputBuffer();
+       InputZeros(InputProcessor.WindowLen);         // one window of zeros clears all the taps
+       ProcessInputBuffer();
+       Pool.Run(FlushJob,this); }
+
+   size_t ModeCount(void)
+     { return Modes; }
+
+   MFSK_Parameters<Type> *ModeParameters(size_t Mode)
+     { return Parameters+Mode; }
+
+   // the receiver of the given mode: for its S/N, frequency offset and the decoded characters
+   MFSK_Receiver<Type> *ModeReceiver(size_t Mode)
+     { return Receiver+Mode; }
+
+   // the mode with a stable lock and the best S/N, -1 if none is locked
+   int BestMode(void)
+     { int Best=(-1);
+       size_t Mode;
+       for(Mode=0; Mode<Modes; Mode++)
+       { if(Receiver[Mode].IsParked()||(!Receiver[Mode].StableLock())) continue;
+         if((Best<0)||(Receiver[Mode].SyncSNR()>Receiver[Best].SyncSNR())) Best=Mode; }
+       return Best; }
+
+  private:
+
+   // append zeros to the input buffer
+   void InputZeros(size_t Len)
+     { ClearArray(InputBuffer.Window(InputFill),Len);
+       InputBuffer.Mirror(InputFill,Len);
+       InputFill+=Len; }
+
+   // process the input buffer: the input processor, then all the modes
+   void ProcessInputBuffer(void)
+     { while(InputFill>=InputProcessor.WindowLen)
+       { InputProcessor.Process(InputBuffer.Window());
+         InputBuffer+=InputProcessor.WindowLen;
+         InputFill-=InputProcessor.WindowLen;
+         Pool.Run(ModeJob,this);
+         if(Prune) PruneModes(); }
+     }
+
+   // while a mode has a stable lock only its synchronizer runs, the other modes keep
+   // just their demodulators and are woken up (with a replay) when the lock is lost
+   void PruneModes(void)
+     { int Best=BestMode();
+       size_t Mode;
+       for(Mode=0; Mode<Modes; Mode++)
+         Receiver[Mode].Park( (Best>=0) && (Mode!=(size_t)Best) ); }
+
+   // the modes are dealt out to the workers in turn
+   static void ModeJob(void *Context, size_t Worker)
+     { MFSK_MultiReceiver<Type> *Multi=(MFSK_MultiReceiver<Type> *)Context;
+       size_t Mode;
+       for(Mode=Worker; Mode<Multi->Modes; Mode+=Multi->Pool.Workers)
+         Multi->Receiver[Mode].ProcessShared(Multi->InputProcessor.Output,Multi->InputProcessor.WindowLen); }
+
+   static void FlushJob(void *Context, size_t Worker)
+     { MFSK_MultiReceiver<Type> *Multi=(MFSK_MultiReceiver<Type> *)Context;
+       size_t Mode;
+       for(Mode=Worker; Mode<Multi->Modes; Mode+=Multi->Pool.Workers)
+         Multi->Receiver[Mode].FlushShared(); }
+
+} ;
+
+// =====================================================================
+// Wideband skimmer: decodes every signal of one mode found across the passband.
+// A single rate converter, input processor and demodulator (with its spectra history)
+// cover the whole passband, the coarse frequency search finds the signals there
+// and each one gets a channel: a synchronizer and a decoder of its own
+// working on the shared history. The channels are spread over worker threads.
+
+template <class Type=float>
+ class MFSK_Skimmer
+{ public:
+
+   MFSK_Parameters<Type> *Parameters;        // the mode to look for
+
+   static const size_t MaxChannels = 16;
+
+   // the user-settable parameters:
+   Type PassbandLow;                         // [Hz] the passband to skim
+   Type PassbandHigh;                        // [Hz]
+   size_t Channels;                          // maximum number of signals decoded at once
+   size_t Workers;                           // threads sharing the channels (including the caller)
+   size_t IdleLimit;                         // [FEC blocks] a channel without stable lock is given up, 0 => 2*(RxSyncIntegLen+1)
+   Type ScoreNoiseScale;                     // [bin power floor] the frequency search score noise
+                                             // for sqrt(2*Carriers/RxSyncIntegLen) averaged bins (measured on white noise)
+
+  private:
+
+   MFSK_Parameters<Type> Wide;               // the parameters of the wideband front-end
+
+   RateConverter<Type> InputRateConverter;
+   MirrorBuffer<Type> InputBuffer;           // rate converter output, read one input processor window at a time
+   size_t InputFill;                         // samples waiting in InputBuffer (from its pointer on)
+   MFSK_InputProcessor<Type> InputProcessor; // equalizes the input spectrum
+   MFSK_Demodulator<Type> Demodulator;       // spectral (FFT) demodulator over the whole passband
+   MFSK_FreqSearch<Type> FreqSearch;         // finds the signals over the passband
+   Type *ZeroSlice;                          // [Demodulator.SliceLen()] zero energies for Flush()
+   size_t SearchBlocks;                      // FEC blocks the frequency search has been averaging
+
+   struct Channel
+   { int Active;                             // the channel is in use
+     size_t SyncBase;                        // where the synchronizer window starts in the spectra [FFT bins]
+     size_t Replay;                          // past slices to synchronize on first (as the channel just started)
+     size_t IdleLen;                         // [FEC blocks] how long without stable lock
+     size_t LocalBest;                       // the best frequency search offset around the signal the block before
+     MFSK_Synchronizer<Type> Synchronizer;
+     MFSK_SoftIterDecoder<Type> Decoder;
+     LockFreeFIFO<uint8_t> Output;           // decoded characters
+   } Chan[MaxChannels];
+
+   WorkerPool Pool;                          // threads sharing the channels
+
+  public:
+
+   MFSK_Skimmer()
+     { Init();
+       Default(); }
+
+   ~MFSK_Skimmer()
+     { Free(); }
+
+   void Init(void)
+     { ZeroSlice=0; }
+
+   void Default(void)
+     { PassbandLow=300;
+       PassbandHigh=3000;
+       Channels=8;
+       Workers=1;
+       IdleLimit=0;
+       ScoreNoiseScale=0.08; }
+
+   void Free(void)
+     { Pool.Free();
+       InputRateConverter.Free();
+       InputBuffer.Free();
+       InputProcessor.Free();
+       Demodulator.Free();
+       FreqSearch.Free();
+       size_t Idx;
+       for(Idx=0; Idx<MaxChannels; Idx++)
+       { Chan[Idx].Synchronizer.Free();
+         Chan[Idx].Decoder.Free();
+         Chan[Idx].Output.Free(); }
+       free(ZeroSlice); ZeroSlice=0; }
+
+   // resize internal arrays according the (preset) parameters and the passband
+   int Preset(MFSK_Parameters<Type> *NewParameters)
+     { Parameters=NewParameters;
+
+       Wide=(*Parameters);                   // the same mode, the search margin covers the passband
+       Type Margin=((PassbandHigh-PassbandLow)-Wide.Bandwidth)/2;
+       if(Margin<0) Margin=0;
+       Wide.LowerBandEdge=PassbandLow+Margin;
+       Wide.RxSearchMargin=(size_t)floor(Margin/Wide.CarrierBandwidth());
+       Wide.RxSyncThreads=1;                 // the parallelism is over the channels
+       Wide.RxCompactHistory=0;              // the channels read the history concurrently
+       Wide.RxCarrierMajor=0;
+       Wide.RxBandLimit=0;
+       Wide.RxBaseband=0;
+       Wide.RxDetectThreshold=0;
+       Wide.RxEarlyDecode=0;
+       Wide.RxPipeline[0]=Wide.RxPipeline[1]=Wide.RxPipeline[2]=0;
+       Wide.Preset();
+
+       InputRateConverter.OutputRate=Wide.SampleRate/Wide.InputSampleRate;
+       if(InputRateConverter.Preset()<0) goto Error;
+
+       InputProcessor.WindowLen=32*Wide.SymbolSepar;
+       if(InputProcessor.Preset()<0) goto Error;
+
+       if(InputBuffer.Preset(2*InputProcessor.WindowLen)<0) goto Error;
+       InputFill=0;
+
+       if(Demodulator.Preset(&Wide)<0) goto Error;
+       if(ReallocArray(&ZeroSlice,Demodulator.SliceLen())<0) goto Error;
+       ClearArray(ZeroSlice,Demodulator.SliceLen());
+       if(FreqSearch.Preset(&Wide)<0) goto Error;
+       SearchBlocks=0;
+
+       if(Channels>MaxChannels) Channels=MaxChannels;
+       if(Channels<1) Channels=1;
+       size_t Idx;
+       for(Idx=0; Idx<Channels; Idx++)
+       { Channel &Chan=this->Chan[Idx];
+         if(Chan.Synchronizer.Preset(&Wide)<0) goto Error;
+         if(Chan.Decoder.Preset(&Wide)<0) goto Error;
+         Chan.Output.Len=1024;
+         if(Chan.Output.Preset()<0) goto Error;
+         Chan.Active=0; }
+
+       Pool.Workers = Workers<Channels ? Workers:Channels;
+       if(Pool.Preset()<0) goto Error;
+
+       return 0;
+
+       Error: Free(); return -1; }
+
+   void Reset(void)
+     { InputRateConverter.Reset();
+       InputBuffer.Reset();
+       InputFill=0;
+       InputProcessor.Reset();
+       Demodulator.Reset();
+       FreqSearch.Reset();
+       SearchBlocks=0;
+       size_t Idx;
+       for(Idx=0; Idx<Channels; Idx++)
+       { Chan[Idx].Active=0;
+         Chan[Idx].Output.Reset(); }
+     }
+
+   // process an audio batch
+   template <class InpType>
+    int Process(InpType *Input, size_t InputLen)
+     { while(InputLen)
+       { size_t Space=InputBuffer.Len-InputFill;     // the rate converter output fits into what is free
+         size_t Chunk=(size_t)floor((Space-3)/InputRateConverter.OutputRate);
+         if(Chunk<1) Chunk=1;
+         if(Chunk>InputLen) Chunk=InputLen;
+         int OutLen=InputRateConverter.Process(Input, Chunk, InputBuffer.Window(InputFill));
+         InputBuffer.Mirror(InputFill,OutLen);
+         InputFill+=OutLen;
+         Input+=Chunk; InputLen-=Chunk;
+         ProcessInputBuffer(); }
+       return 0; }
+
+   // push the (partial) input through with zeros until the last blocks are decoded
+   // (as the fast Flush() of the receiver)
+   void Flush(void)
+     { ProcessInputBuffer();
+       InputZeros(InputProcessor.WindowLen-InputFill);
+       ProcessInputBuffer();
+       InputZeros(InputProcessor.WindowLen);         // one window of zeros clears all the taps
+       ProcessInputBuffer();
+       size_t SpectraPerBlock=Wide.SpectraPerBlock;
+       size_t DrainLen=(Wide.RxSyncIntegLen+1)*SpectraPerBlock+SpectraPerBlock/2+3;
+       size_t Idx,Slice;
+       for(Idx=0; Idx<DrainLen; Idx+=Wide.SpectraPerSymbol)
+       { for(Slice=0; Slice<Wide.SpectraPerSymbol; Slice++)
+           Demodulator.StoreSlice(ZeroSlice);
+         ProcessSpectra(); }
+     }
+
+   // is the channel decoding a signal ?
+   int ChannelActive(size_t Idx)
+     { return Chan[Idx].Active; }
+
+   // the lower band edge of the channel's signal [Hz]
+   Type ChannelFrequency(size_t Idx)
+     { Channel &Chan=this->Chan[Idx];
+       size_t First=Wide.FirstCarrier-Wide.SearchMargin*Wide.CarrierSepar;
+       size_t Carrier=First+Chan.SyncBase+Wide.RxSyncMargin*Wide.CarrierSepar;
+       return (Carrier-(Type)Wide.CarrierSepar/2)*Wide.FFTbinBandwidth()+Chan.Synchronizer.FrequencyOffset(); }
+
+   Type ChannelSNR(size_t Idx)
+     { return Chan[Idx].Synchronizer.FEC_SNR(); }
+
+   // get one character decoded by the channel
+   int GetChar(size_t Idx, uint8_t &Char)
+     { return Chan[Idx].Output.Read(Char); }
+
+  private:
+
+   // append zeros to the input buffer
+   void InputZeros(size_t Len)
+     { ClearArray(InputBuffer.Window(InputFill),Len);
+       InputBuffer.Mirror(InputFill,Len);
+       InputFill+=Len; }
+
+   // process the input buffer: first the input processor, then the demodulator
+   void ProcessInputBuffer(void)
+     { while(InputFill>=InputProcessor.WindowLen)
+       { InputProcessor.Process(InputBuffer.Window());
+         InputBuffer+=InputProcessor.WindowLen;
+         InputFill-=InputProcessor.WindowLen;
+         size_t Idx;
+         for(Idx=0; Idx<InputProcessor.WindowLen; Idx+=Wide.SymbolSepar)
+         { Demodulator.Process(InputProcessor.Output+Idx);
+           ProcessSpectra(); }
+       }
+     }
+
+   // the slices of the last symbol: search for signals, then run the channels
+   void ProcessSpectra(void)
+     { int HistOfs;
+       for(HistOfs=(-(int)Wide.SpectraPerSymbol); HistOfs<0; HistOfs++)
+         if(FreqSearch.Process(Demodulator.HistoryPtr(HistOfs))) FindSignals();
+       Pool.Run(ChannelJob,this); }
+
+   // once per FEC block: give up the channels which lost the signal or decode the same one
+   // as another channel, then start one on every signal which stands out and is not yet decoded
+   void FindSignals(void)
+     { SearchBlocks+=1;
+       size_t Limit = IdleLimit ? IdleLimit:2*(Wide.RxSyncIntegLen+1);
+       size_t Reach=Wide.Carriers*Wide.CarrierSepar;  // the tone comb scores high that far from a signal
+       size_t SyncMargin=Wide.RxSyncMargin*Wide.CarrierSepar;
+       size_t Idx,Other;
+       for(Idx=0; Idx<Channels; Idx++)
+       { Channel &Chan=this->Chan[Idx];
+         if(!Chan.Active) continue;
+         if(Chan.Synchronizer.StableLock) { Chan.IdleLen=0; continue; }
+         Chan.IdleLen+=1;
+         if(Chan.IdleLen>=Limit) { Chan.Active=0; continue; }
+         MoveSyncWindow(Chan); }
+       for(Idx=0; Idx<Channels; Idx++)                  // two locks on overlapping tones: one is an alias
+       { if(!(Chan[Idx].Active&&Chan[Idx].Synchronizer.StableLock)) continue;
+         for(Other=Idx+1; Other<Channels; Other++)
+         { if(!(Chan[Other].Active&&Chan[Other].Synchronizer.StableLock)) continue;
+           if(Distance(SignalOffset(Chan[Idx]),SignalOffset(Chan[Other]))>=Reach) continue;
+           if(ChannelSNR(Idx)<ChannelSNR(Other)) { Chan[Idx].Active=0; break; }
+           Chan[Other].Active=0; }
+       }
+
+       size_t Offsets=2*Wide.SearchMargin*Wide.CarrierSepar+1;
+       Type Noise=ScoreNoise();
+       for( ; ; )
+       { size_t Free;
+         for(Free=0; Free<Channels; Free++)
+           if(!Chan[Free].Active) break;
+         if(Free>=Channels) break;
+         Type BestScore=0; size_t Best=Offsets;    // the best offset, which no channel can reach
+         size_t Offset;                             // (within its synchronizer window)
+         for(Offset=0; Offset<Offsets; Offset++)
+         { if(FreqSearch.Score[Offset]<=BestScore) continue;
+           for(Idx=0; Idx<Channels; Idx++)
+             if(Chan[Idx].Active && (Distance(Offset,SignalOffset(Chan[Idx]))<(Reach+SyncMargin))) break;
+           if(Idx<Channels) continue;
+           BestScore=FreqSearch.Score[Offset]; Best=Offset; }
+         if(Best>=Offsets) break;
+         if(BestScore<FreqSearch.Threshold*Noise) break;
+         Channel &Chan=this->Chan[Free];
+         PlaceSyncWindow(Chan,Best);
+         Chan.LocalBest=Best;
+         Chan.IdleLen=0;
+         Chan.Active=1; }
+     }
+
+   // where the synchronizer window starts when centered on given offset,
+   // clamped to the passband
+   size_t SyncBaseFor(size_t Offset)
+     { size_t SyncMargin=Wide.RxSyncMargin*Wide.CarrierSepar;
+       size_t MaxBase=2*(Wide.SearchMargin-Wide.RxSyncMargin)*Wide.CarrierSepar;
+       size_t Base = Offset>SyncMargin ? Offset-SyncMargin : 0;
+       return Base>MaxBase ? MaxBase : Base; }
+
+   // center the synchronizer window of the channel on given offset
+   // and let it catch up with the history
+   void PlaceSyncWindow(Channel &Chan, size_t Offset)
+     { Chan.SyncBase=SyncBaseFor(Offset);
+       Chan.Synchronizer.Reset();
+       Chan.Replay=(Wide.RxSyncIntegLen+1)*Wide.SpectraPerBlock-Wide.SpectraPerSymbol; }
+
+   // as MFSK_Receiver::MoveSyncWindow() but for the best offset around the channel's signal:
+   // the first candidate is often a carrier or more off, as the tone comb scores high there too
+   void MoveSyncWindow(Channel &Chan)
+     { size_t SyncMargin=Wide.RxSyncMargin*Wide.CarrierSepar;
+       size_t Reach=Wide.Carriers*Wide.CarrierSepar;
+       size_t Offsets=2*Wide.SearchMargin*Wide.CarrierSepar+1;
+       size_t Center=Chan.SyncBase+SyncMargin;
+       size_t Offset = Center>Reach ? Center-Reach : 0;
+       size_t Stop = Center+Reach<Offsets ? Center+Reach : Offsets-1;
+       size_t Best=Center;
+       for( ; Offset<=Stop; Offset++)
+         if(FreqSearch.Score[Offset]>FreqSearch.Score[Best]) Best=Offset;
+       size_t Prev=Chan.LocalBest; Chan.LocalBest=Best;
+       if(Distance(Best,Prev)>Wide.CarrierSepar) return;      // the candidate must stay for two blocks
+       if(2*Distance(Best,Center)<=SyncMargin) return;        // still well within the window
+       if(SyncBaseFor(Best)==Chan.SyncBase) return;           // the window can not move further
+       PlaceSyncWindow(Chan,Best); }
+
+   // where the channel's signal (its lowest tone) is in the spectra [FFT bins]:
+   // as locked or else the middle of the synchronizer window
+   size_t SignalOffset(Channel &Chan)
+     { if(Chan.Synchronizer.StableLock) return Chan.SyncBase+Chan.Synchronizer.SyncBestFreqOffset;
+       return Chan.SyncBase+Wide.RxSyncMargin*Wide.CarrierSepar; }
+
+   static size_t Distance(size_t A, size_t B)
+     { return A>B ? A-B : B-A; }
+
+   // the noise level of the frequency search score: FreqSearch.ScoreRMS is spoiled
+   // when several signals are present, thus it comes from the bin power floor instead:
+   // the score sums 2*Carriers bins averaged over RxSyncIntegLen FEC blocks
+   // (over fewer when it just started: the average grows slower than its noise),
+   // ScoreNoiseScale scales it to the score noise measured on white noise
+   Type ScoreNoise(void)
+     { Type Integ=Wide.RxSyncIntegLen;
+       Type Decay=exp(-(Type)SearchBlocks/Integ);
+       Type Startup=sqrt(1-Decay*Decay)/(1-Decay);
+       return ScoreNoiseScale*sqrt(2*Wide.Carriers/Integ)*Startup*FreqSearch.FloorPower(); }
+
+   // the channels are dealt out to the workers in turn
+   static void ChannelJob(void *Context, size_t Worker)
+     { MFSK_Skimmer<Type> *Skim=(MFSK_Skimmer<Type> *)Context;
+       size_t Idx;
+       for(Idx=Worker; Idx<Skim->Channels; Idx+=Skim->Pool.Workers)
+         Skim->ProcessChannel(Skim->Chan[Idx]); }
+
+   // synchronize the channel on the slices of the last symbol (and the replay)
+   // and decode a FEC block when in the middle of it: as MFSK_Receiver::ProcessSlice()
+   void ProcessChannel(Channel &Chan)
+     { if(!Chan.Active) return;
+       size_t SpectraPerBlock=Wide.SpectraPerBlock;
+       int HistOfs=(-(int)(Chan.Replay+Wide.SpectraPerSymbol));
+       Chan.Replay=0;
+       for( ; HistOfs<0; HistOfs++)
+       { Chan.Synchronizer.Process(Demodulator.HistoryPtr(HistOfs)+Chan.SyncBase);
+         if(Chan.Synchronizer.DecodeReference!=0) continue;
+         if(!Chan.Synchronizer.StableLock) continue;
+         int TimeOffset = (HistOfs-((Wide.RxSyncIntegLen+1)*SpectraPerBlock+SpectraPerBlock/2-1));
+         int FreqOffset = Chan.SyncBase+Chan.Synchronizer.SyncBestFreqOffset;
+         if(MFSK_DecodeBlock(Demodulator,Chan.Decoder,TimeOffset,FreqOffset)<0) continue;
+         Chan.Decoder.WriteOutputBlock(Chan.Output); }
+     }
 
 } ;
 
@@ -33,9 +33,11 @@ int LogText           = 0;       // log the decoded text to a file
 int LogAudio          = 0;       // log the received audio to a file
 
 SoundDevice Sound;            // sound card
+SoundMonitor Monitor;         // watches whether we keep up with the sound card
 size_t SampleRate=8000;       // sample rate we request from the sound card
 char DeviceName[16] = "/dev/dsp";  // sound card device name
 char *InputFileName=0;        // the name of the input file (specified on the command line)
+char *StateFileName=0;        // the receiver state is loaded from this file at start and saved at the end
 
 char AudioFileName[32];       // file name to save audio
 char TextFileName[32];        // file name to save decoded text
@@ -71,6 +73,10 @@ int main(int argc, char *argv[])
           case 'L':
             LogAudio=1;
             break;
+          case 's':
+            if(argv[arg][2]) StateFileName=argv[arg]+2;
+                        else Help=1;
+            break;
           case 'd':
             if(isdigit(argv[arg][2]))
 		    { strcpy(DeviceName,"/dev/dsp"); strcat(DeviceName,argv[arg]+2); }
@@ -101,6 +107,7 @@ mfsk_rx [options] [<audio file>]\n\
   -p                    playback the file through the soundcard\n\
   -l                    log the decoded text to a file\n\
   -L                    log the received audio to a file\n\
+  -s<file>              resume from the receiver state in the file and save it there at the end\n\
 "         );
     printf("%s\n",Parameters.OptionHelp());
     return -1; }
@@ -124,6 +131,8 @@ mfsk_rx [options] [<audio file>]\n\
       return -1; }
   }
 
+  Monitor.Reset(Sound.Rate);
+
   Error=Parameters.Preset();
   if(Error<0)
   { printf("Parameters.Preset() => %d\n",Error); return -1; }
@@ -133,20 +142,31 @@ mfsk_rx [options] [<audio file>]\n\
   if(Error<0)
   { printf("Receiver.Preset() => %d\n",Error); return -1; }
 
-  Error=Terminal.Preset(0,LogText ? TextFileName:0);
+  if(StateFileName) // resume where the previous run stopped (if the file is there)
+  { FILE *StateFile=fopen(StateFileName,"rb");
+    if(StateFile)
+    { Error=Receiver.LoadState(StateFile);
+      fclose(StateFile);
+      if(Error<0) printf("Receiver.LoadState() => %d: starting afresh\n",Error); }
+  }
+
+  Error=Terminal.Preset(0,LogText ? TextFileName:0,1);
   if(Error<0)
   { printf("Terminal.Preset() => %d\n",Error); return -1; }
 
   char Mode[80];
   sprintf(Mode,"Mode: %d tones, %d Hz, %4.2f baud, %3.1f sec/block, %3.1f chars/sec",
-           Parameters.Carriers,
-		   Parameters.Bandwidth,
+           (int)Parameters.Carriers,
+		   (int)Parameters.Bandwidth,
 		   Parameters.BaudRate(),
 		   Parameters.BlockPeriod(),
 		   Parameters.CharactersPerSecond() );
 
   Terminal.RxStatUpp(Mode);
 
+  char MonitorStatus[128];
+  strcpy(MonitorStatus,"Audio: ");
+
   char Status[80];
   sprintf(Status,"Status:");
 
@@ -155,10 +175,16 @@ mfsk_rx [options] [<audio file>]\n\
   size_t SymbolCounter=0;
   for( ; ; SymbolCounter++)
   { int Len=Sound.Read(AudioBuffer,AudioBufferLen);
+    Monitor.Read(Sound,Len,AudioBufferLen);
     if(Len<=0) break;  // if no more audio data or an error then break the loop
 
     // let the receiver process the audio in the buffer
     Receiver.Process(AudioBuffer,Len);
+    Monitor.Processed(Len);
+
+    // update the monitor line: how we keep up with the audio
+    Monitor.Status(MonitorStatus+7);
+    Terminal.MonStat(MonitorStatus);
 
     // update the status: S/N and frequency offset
     sprintf(Status,"Rx S/N: %4.1f,  %+5.1f dB,   %+4.1f/%4.1f Hz,  %+5.1f Hz/min,  %+5.0f ppm",
@@ -179,6 +205,14 @@ mfsk_rx [options] [<audio file>]\n\
     if(Terminal.UserInp(Key)) { break; }
   }
 
+  // save the receiver state before the flush, which pads the input with silence
+  int StateError=0;
+  if(StateFileName)
+  { FILE *StateFile=fopen(StateFileName,"wb");
+    StateError = StateFile ? Receiver.SaveState(StateFile):-1;
+    if(StateFile && fclose(StateFile)) StateError=-1;
+    if(StateError<0) remove(StateFileName); }
+
   // flush the receiver:
   Receiver.Flush();
   // and then check for decoded characters
@@ -190,6 +224,12 @@ mfsk_rx [options] [<audio file>]\n\
 
   sleep(3);          // wait three seconds before closing the terminal window
   Terminal.Close();  // close the terminal
+
+  Monitor.Print();   // did we keep up with the audio ?
+
+  if(StateError<0) printf("Can not save the receiver state to %s\n",StateFileName);
+
+  if(Parameters.RxStats) Receiver.Stats.Print(); // where the receiver spent its time
   Sound.Close();     // close the audio device
 
   return 0; }
@@ -0,0 +1,155 @@
+// MFSK skimmer: decodes all signals of a mode found in the passband
+
+// ====================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "mfsk.h"
+#include "sound.h"
+
+// ====================================================================
+
+// program parameters (can be changed with the command line options)
+
+SoundDevice Sound;            // sound card
+size_t SampleRate=8000;       // sample rate we request from the sound card
+char DeviceName[16] = "/dev/dsp";  // sound card device name
+char *InputFileName=0;        // the name of the input file (specified on the command line)
+
+const size_t AudioBufferLen=2048;
+int16_t AudioBuffer[AudioBufferLen]; // audio buffer
+
+MFSK_Parameters<float> Parameters; // the mode to look for
+
+MFSK_Skimmer<float> Skimmer;    // finds and decodes the signals
+
+const size_t LineLen=64;
+char Line[MFSK_Skimmer<float>::MaxChannels][LineLen+1]; // the text collected per channel
+size_t LineFill[MFSK_Skimmer<float>::MaxChannels];
+
+// print the text collected for the channel
+void PrintLine(size_t Idx)
+{ if(LineFill[Idx]==0) return;
+  Line[Idx][LineFill[Idx]]=0;
+  printf("%2d %6.1f Hz %4.1f: %s\n",
+         (int)Idx, Skimmer.ChannelFrequency(Idx), Skimmer.ChannelSNR(Idx), Line[Idx]);
+  fflush(stdout);
+  LineFill[Idx]=0; }
+
+// collect the decoded characters, print a line when complete
+void ReadChars(void)
+{ size_t Idx;
+  for(Idx=0; Idx<Skimmer.Channels; Idx++)
+  { uint8_t Char;
+    while(Skimmer.GetChar(Idx,Char)>0)
+    { if((Char=='\n')||(Char=='\r')) { PrintLine(Idx); continue; }
+      if((Char<' ')||(Char>=127)) continue;
+      Line[Idx][LineFill[Idx]++]=Char;
+      if(LineFill[Idx]>=LineLen) PrintLine(Idx); }
+    if(!Skimmer.ChannelActive(Idx)) PrintLine(Idx);
+  }
+}
+
+int main(int argc, char *argv[])
+{ int Error;
+
+  // read the command line options and the input file name (if specified)
+  int arg;
+  int Help=0;
+  for(arg=1; arg<argc; arg++)
+  { if(argv[arg][0]=='-') // if '-' then this is an option, otherwise the name of a file
+    { int Error=Parameters.ReadOption(argv[arg]);
+      if(Error<0)
+      { printf("Invalid parameter(s) in %s\n",argv[arg]); }
+      else if(Error==0)
+      { switch(argv[arg][1])
+        { case 'd':
+            if(isdigit(argv[arg][2]))
+            { strcpy(DeviceName,"/dev/dsp"); strcat(DeviceName,argv[arg]+2); }
+            else if(argv[arg][2]=='/')
+            { strcpy(DeviceName,argv[arg]+2); }
+            else if(argv[arg][2]=='\0')
+            { strcpy(DeviceName,"/dev/dsp"); }
+            else
+            { printf("Unreadable device number or name: %s\n",argv[arg]); Help=1; }
+            break;
+          case 'f':
+            float Low,High;
+            if(sscanf(argv[arg]+2,"%f/%f",&Low,&High)==2)
+            { Skimmer.PassbandLow=Low; Skimmer.PassbandHigh=High; }
+            else Help=1;
+            break;
+          case 'n':
+            int Channels;
+            if(sscanf(argv[arg]+2,"%d",&Channels)==1) Skimmer.Channels=Channels;
+                                               else Help=1;
+            break;
+          case 'w':
+            int Workers;
+            if(sscanf(argv[arg]+2,"%d",&Workers)==1) Skimmer.Workers=Workers;
+                                              else Help=1;
+            break;
+          default:
+            Help=1;
+            break;
+        }
+      }
+    }
+    else
+    { if(InputFileName==0) InputFileName=argv[arg];
+                      else Help=1;
+    }
+  }
+
+  if(Help)
+  { printf("\n\
+mfsk_skim [options] [<audio file>]\n\
+ options:\n\
+  -d<device>            the soundcard device number or name [/dev/dsp]\n\
+  -f<low>/<high>        the passband to skim [300/3000] [Hz]\n\
+  -n<channels>          signals decoded at once [8]\n\
+  -w<workers>           threads decoding the channels [1]\n\
+"         );
+    printf("%s\n",Parameters.OptionHelp());
+    return -1; }
+
+  // open the sound card (or specified file) for read
+  if(InputFileName)
+  { if(Sound.OpenFileForRead(InputFileName,SampleRate,0)<0)
+    { printf("Can not open the sound device or file ?\n");
+      return -1; }
+  } else
+  { if(Sound.OpenForRead(DeviceName,SampleRate,0)<0)
+    { printf("Can not open the sound device or file ?\n");
+      return -1; }
+  }
+
+  Error=Parameters.Preset();
+  if(Error<0)
+  { printf("Parameters.Preset() => %d\n",Error); return -1; }
+
+  Error=Skimmer.Preset(&Parameters);
+  if(Error<0)
+  { printf("Skimmer.Preset() => %d\n",Error); return -1; }
+
+  printf("Mode: %d tones, %d Hz, %4.2f baud, skimming %3.0f-%3.0f Hz with %d channels\n",
+         (int)Parameters.Carriers, (int)Parameters.Bandwidth, Parameters.BaudRate(),
+         Skimmer.PassbandLow, Skimmer.PassbandHigh, (int)Skimmer.Channels);
+
+  for( ; ; )
+  { int Len=Sound.Read(AudioBuffer,AudioBufferLen);
+    if(Len<=0) break;  // if no more audio data or an error then break the loop
+    Skimmer.Process(AudioBuffer,Len);
+    ReadChars(); }
+
+  Skimmer.Flush();
+  ReadChars();
+  size_t Idx;
+  for(Idx=0; Idx<Skimmer.Channels; Idx++)
+    PrintLine(Idx);
+
+  Sound.Close();
+
+  return 0; }
@@ -4,10 +4,16 @@
 // A simulation for the MFSK_Transmitter, MFSK_Receiver
 // and a (very) noisy path between the two.
 
+// mfsk_test multi : two modes one after the other on one input
+//                   into the MFSK_MultiReceiver, which must lock each in turn
+// mfsk_test loop  : one known message through the receiver with every option
+//                   (and through the MFSK_Skimmer), compared to the default receiver
+
 // ===================================================================
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "mfsk.h"
@@ -38,6 +44,16 @@ void AddNoise(float *Data, size_t Len, float RMS=1.0)
   }
 }
 
+// read the (final) characters from the receiver as a string, non-printable ones as '.'
+size_t ReadText(MFSK_Receiver<float> &Receiver, char *Text, size_t MaxLen)
+{ size_t Len;
+  for(Len=0; Len<MaxLen; Len++)
+  { uint8_t Char;
+    if(Receiver.GetChar(Char)==0) break;
+    Text[Len] = (Char>=' ')&&(Char<127) ? Char:'.'; }
+  Text[Len]=0;
+  return Len; }
+
 // ===================================================================
 
 MFSK_Parameters<float>  Parameters;
@@ -45,9 +61,348 @@ MFSK_Parameters<float>  Parameters;
 MFSK_Transmitter<float> Transmitter;
 MFSK_Receiver<float>    Receiver;
 
+// ===================================================================
+
+const char *MultiMode[2][2] = { { "-T32", "-B1000" }, { "-T8", "-B500" } };
+const char *MultiMessage[2] = { "first message: 32 tones, 1000 Hz",
+                                "second message: 8 tones, 500 Hz" };
+
+MFSK_Parameters<float>   MultiParameters[2];
+MFSK_Transmitter<float>  MultiTransmitter[2];
+MFSK_MultiReceiver<float> MultiReceiver;
+
+// every mode sends its message in turn: the multi-receiver must report that mode
+// as the best one while it is sent (the other one is parked meanwhile
+// and must wake up when the lock is lost) and both messages must come out complete.
+// A stable lock outlives its signal by tens of seconds, thus there is noise in between
+// until no mode is locked
+int MultiTest(void)
+{ int Error;
+  size_t Mode;
+  for(Mode=0; Mode<2; Mode++)
+  { MultiParameters[Mode].ReadOption((char *)MultiMode[Mode][0]);
+    MultiParameters[Mode].ReadOption((char *)MultiMode[Mode][1]);
+    Error=MultiParameters[Mode].Preset();
+    if(Error<0) { printf("MultiParameters[%d].Preset() => %d\n",(int)Mode,Error); return -1; }
+    Error=MultiTransmitter[Mode].Preset(MultiParameters+Mode);
+    if(Error<0) { printf("MultiTransmitter[%d].Preset() => %d\n",(int)Mode,Error); return -1; } }
+
+  Error=MultiReceiver.Preset(MultiParameters,2);
+  if(Error<0) { printf("MultiReceiver.Preset() => %d\n",Error); return -1; }
+
+  float NoiseRMS=1.0;
+  size_t BestCount[2][3];                            // [sent mode][best mode: 0, 1, none]
+  memset(BestCount,0,sizeof(BestCount));
+
+  float Noise[512];
+  for(Mode=0; Mode<2; Mode++)
+  { MFSK_Transmitter<float> &Transmitter=MultiTransmitter[Mode];
+    size_t Idx;
+    for(Idx=0; (Idx<4000)&&(MultiReceiver.BestMode()>=0); Idx++)
+    { memset(Noise,0,sizeof(Noise));
+      AddNoise(Noise,512,NoiseRMS);
+      MultiReceiver.Process(Noise,512); }
+    for(Idx=0; Idx<20; Idx++)
+      Transmitter.PutChar(0);
+    for(Idx=0; MultiMessage[Mode][Idx]; Idx++)
+      Transmitter.PutChar(MultiMessage[Mode][Idx]);
+    Transmitter.Start();
+    Transmitter.Stop();
+    for( ; ; )
+    { float *OutputPtr=0;
+      int Len=Transmitter.Output(OutputPtr);
+      if(!Transmitter.Running()) break;
+      AddNoise(OutputPtr,Len,NoiseRMS);
+      MultiReceiver.Process(OutputPtr,Len);
+      int Best=MultiReceiver.BestMode();
+      BestCount[Mode][Best<0 ? 2:Best]+=1; }
+  }
+
+  MultiReceiver.Flush();
+
+  int Failed=0;
+  for(Mode=0; Mode<2; Mode++)
+  { char Text[1024];
+    ReadText(*MultiReceiver.ModeReceiver(Mode),Text,sizeof(Text)-1);
+    int Locked = BestCount[Mode][Mode]>BestCount[Mode][1-Mode];
+    int Decoded = strstr(Text,MultiMessage[Mode])!=0;
+    printf("Mode %s %s: best while sent %d, other %d, none %d batches => %s, %s\n",
+           MultiMode[Mode][0], MultiMode[Mode][1],
+           (int)BestCount[Mode][Mode], (int)BestCount[Mode][1-Mode], (int)BestCount[Mode][2],
+           Locked ? "locked":"NOT LOCKED", Decoded ? "decoded":"NOT DECODED");
+    printf("  %s\n",Text);
+    if((!Locked)||(!Decoded)) Failed=1; }
+
+  return Failed; }
+
+// ===================================================================
+
+const char *LoopMessage = "The quick brown fox jumps over the lazy dog 0123456789";
+
+// every receiver option on its own: the message must come out complete with each,
+// options which only change how (not what) the receiver computes must give the very same text
+// as the default receiver, so must the full Flush(0) and a save/restore in the middle of the message.
+// Options with their own spectra history layout save/restore to their own text as well
+struct LoopOption
+{ const char *Option;
+  int Exact;                                        // must give the default text
+  int Save; } LoopOptions[] =                       // check save/restore as well
+{ { "-P2",   1, 0 }, { "-H",    0, 0 }, { "-Q8",   0, 0 }, { "-Q16",  0, 0 },
+  { "-C",    0, 1 }, { "-K",    1, 1 }, { "-F",    0, 0 }, { "-X",    0, 0 },
+  { "-W8",   0, 0 }, { "-D5",   0, 0 }, { "-A4",   0, 0 }, { "-G012", 1, 0 },
+  { "-E",    1, 0 }, { "-V",    1, 0 }, { 0, 0, 0 } };
+
+float *LoopInput=0;                                 // the noisy transmitter output
+size_t LoopLen=0;
+const size_t LoopBatch=512;                         // samples given to the receiver at a time
+
+// the transmitted message plus noise, with a noise tail for the receiver to lose the lock,
+// the transmitter can be off-tuned by Shift [Hz]
+int LoopGenerate(float Shift=0, float NoiseRMS=1.0)
+{ MFSK_Parameters<float> TxParameters;
+  TxParameters.ReadOption("-T32");
+  TxParameters.ReadOption("-B1000");
+  TxParameters.LowerBandEdge+=Shift;
+  int Error=TxParameters.Preset();
+  if(Error<0) { printf("TxParameters.Preset() => %d\n",Error); return -1; }
+  Error=Transmitter.Preset(&TxParameters);
+  if(Error<0) { printf("Transmitter.Preset() => %d\n",Error); return -1; }
+
+  size_t Idx;
+  for(Idx=0; Idx<20; Idx++)
+    Transmitter.PutChar(0);
+  for(Idx=0; LoopMessage[Idx]; Idx++)
+    Transmitter.PutChar(LoopMessage[Idx]);
+  Transmitter.Start();
+  Transmitter.Stop();
+
+  size_t Size=0;
+  LoopLen=0;
+  for( ; ; )
+  { float *OutputPtr=0;
+    int Len=Transmitter.Output(OutputPtr);
+    if(!Transmitter.Running()) break;
+    if((LoopLen+Len)>Size)
+    { Size=2*(LoopLen+Len);
+      LoopInput=(float *)realloc(LoopInput,Size*sizeof(float));
+      if(LoopInput==0) return -1; }
+    memcpy(LoopInput+LoopLen,OutputPtr,Len*sizeof(float));
+    LoopLen+=Len; }
+
+  size_t TailLen=200*1024;
+  LoopInput=(float *)realloc(LoopInput,(LoopLen+TailLen)*sizeof(float));
+  if(LoopInput==0) return -1;
+  memset(LoopInput+LoopLen,0,TailLen*sizeof(float));
+  LoopLen+=TailLen;
+
+  AddNoise(LoopInput,LoopLen,NoiseRMS);
+  return 0; }
+
+// decode LoopInput with the given option (0 => the default), Fast for Flush(),
+// save the state after SaveAt batches into a file and continue on a new receiver (0 => no save)
+int LoopDecode(const char *Option, int Fast, size_t SaveAt, char *Text, size_t MaxLen)
+{ MFSK_Parameters<float> RxParameters;
+  RxParameters.ReadOption("-T32");
+  RxParameters.ReadOption("-B1000");
+  if(Option) RxParameters.ReadOption((char *)Option);
+  int Error=RxParameters.Preset();
+  if(Error<0) { printf("RxParameters.Preset() => %d\n",Error); return -1; }
+
+  MFSK_Receiver<float> *LoopReceiver = new MFSK_Receiver<float>;
+  Error=LoopReceiver->Preset(&RxParameters);
+  if(Error<0) { printf("LoopReceiver->Preset() => %d\n",Error); delete LoopReceiver; return -1; }
+
+  size_t Batch=0;
+  size_t Idx;
+  for(Idx=0; Idx<LoopLen; Idx+=LoopBatch)
+  { size_t Len=LoopLen-Idx; if(Len>LoopBatch) Len=LoopBatch;
+    LoopReceiver->Process(LoopInput+Idx,Len);
+    Batch+=1;
+    if(Batch!=SaveAt) continue;
+    FILE *State=tmpfile();
+    if(State==0) { printf("tmpfile() failed\n"); delete LoopReceiver; return -1; }
+    Error=LoopReceiver->SaveState(State);
+    delete LoopReceiver;
+    LoopReceiver = new MFSK_Receiver<float>;
+    LoopReceiver->Preset(&RxParameters);
+    rewind(State);
+    if(Error>=0) Error=LoopReceiver->LoadState(State);
+    fclose(State);
+    if(Error<0) { printf("SaveState()/LoadState() => %d\n",Error); delete LoopReceiver; return -1; } }
+
+  LoopReceiver->Flush(Fast);
+  ReadText(*LoopReceiver,Text,MaxLen);
+  delete LoopReceiver;
+  return 0; }
+
+MFSK_Parameters<float> SkimParameters;
+MFSK_Skimmer<float>    Skimmer;
+
+// the skimmer over the whole audio band must find the message on one of its channels
+int LoopSkim(void)
+{ SkimParameters.ReadOption("-T32");
+  SkimParameters.ReadOption("-B1000");
+  int Error=SkimParameters.Preset();
+  if(Error<0) { printf("SkimParameters.Preset() => %d\n",Error); return -1; }
+  Error=Skimmer.Preset(&SkimParameters);
+  if(Error<0) { printf("Skimmer.Preset() => %d\n",Error); return -1; }
+
+  static char Text[MFSK_Skimmer<float>::MaxChannels][1024];
+  size_t TextLen[MFSK_Skimmer<float>::MaxChannels];
+  memset(TextLen,0,sizeof(TextLen));
+
+  size_t Idx,Chan;
+  for(Idx=0; Idx<=LoopLen; Idx+=LoopBatch)
+  { if(Idx<LoopLen)
+    { size_t Len=LoopLen-Idx; if(Len>LoopBatch) Len=LoopBatch;
+      Skimmer.Process(LoopInput+Idx,Len); }
+    else Skimmer.Flush();
+    for(Chan=0; Chan<Skimmer.Channels; Chan++)
+    { uint8_t Char;
+      while(Skimmer.GetChar(Chan,Char))
+      { if(TextLen[Chan]>=(sizeof(Text[Chan])-1)) continue;
+        Text[Chan][TextLen[Chan]++] = (Char>=' ')&&(Char<127) ? Char:'.'; }
+      Text[Chan][TextLen[Chan]]=0; }
+  }
+
+  int Found=0;
+  for(Chan=0; Chan<Skimmer.Channels; Chan++)
+  { if(TextLen[Chan]==0) continue;
+    printf("  skimmer channel %d: %s\n",(int)Chan,Text[Chan]);
+    if(strstr(Text[Chan],LoopMessage)) Found=1; }
+  printf("Skimmer => %s\n", Found ? "decoded":"NOT DECODED");
+  return !Found; }
+
+// two messages at different frequencies (within the synchronizer margin) with noise in between
+// until the lock on the first one is lost: with -A the synchronizer tracks the first one
+// and must fall back to the full search to acquire the second one
+const float TrackShift[2] = { 0, +90 };
+const char *TrackMessage[2] = { "first message, at the nominal frequency",
+                                "second message, 90 Hz higher" };
+
+int TrackTest(const char *Option)
+{ MFSK_Parameters<float> RxParameters;
+  RxParameters.ReadOption("-T32");
+  RxParameters.ReadOption("-B1000");
+  RxParameters.ReadOption((char *)Option);
+  int Error=RxParameters.Preset();
+  if(Error<0) { printf("RxParameters.Preset() => %d\n",Error); return -1; }
+
+  MFSK_Receiver<float> *TrackReceiver = new MFSK_Receiver<float>;
+  Error=TrackReceiver->Preset(&RxParameters);
+  if(Error<0) { printf("TrackReceiver->Preset() => %d\n",Error); delete TrackReceiver; return -1; }
+
+  float NoiseRMS=1.0;
+  float Noise[512];
+  size_t Msg,Idx;
+  for(Msg=0; Msg<2; Msg++)
+  { MFSK_Parameters<float> TxParameters;
+    TxParameters.ReadOption("-T32");
+    TxParameters.ReadOption("-B1000");
+    TxParameters.LowerBandEdge+=TrackShift[Msg];
+    TxParameters.Preset();
+    Transmitter.Preset(&TxParameters);
+    for(Idx=0; (Idx<4000)&&TrackReceiver->StableLock(); Idx++)
+    { memset(Noise,0,sizeof(Noise));
+      AddNoise(Noise,512,NoiseRMS);
+      TrackReceiver->Process(Noise,512); }
+    for(Idx=0; Idx<20; Idx++)
+      Transmitter.PutChar(0);
+    for(Idx=0; TrackMessage[Msg][Idx]; Idx++)
+      Transmitter.PutChar(TrackMessage[Msg][Idx]);
+    Transmitter.Start();
+    Transmitter.Stop();
+    for( ; ; )
+    { float *OutputPtr=0;
+      int Len=Transmitter.Output(OutputPtr);
+      if(!Transmitter.Running()) break;
+      AddNoise(OutputPtr,Len,NoiseRMS);
+      TrackReceiver->Process(OutputPtr,Len); }
+  }
+  TrackReceiver->Flush();
+
+  char Text[1024];
+  ReadText(*TrackReceiver,Text,sizeof(Text)-1);
+  delete TrackReceiver;
+  int Decoded[2];
+  for(Msg=0; Msg<2; Msg++)
+    Decoded[Msg] = strstr(Text,TrackMessage[Msg])!=0;
+  printf("%s lock lost and reacquired at %+2.0f Hz => %s, %s\n", Option, TrackShift[1],
+         Decoded[0] ? "first decoded":"first NOT DECODED", Decoded[1] ? "second decoded":"second NOT DECODED");
+  if(Decoded[0]&&Decoded[1]) return 0;
+  printf("  %s\n",Text);
+  return 1; }
+
+int LoopTest(void)
+{ if(LoopGenerate()<0) return -1;
+
+  static char Default[1024], Text[1024];
+  if(LoopDecode(0,1,0,Default,sizeof(Default)-1)<0) return -1;
+  int Failed = strstr(Default,LoopMessage)==0;
+  printf("default => %s\n  %s\n", Failed ? "NOT DECODED":"decoded", Default);
+
+  size_t SaveAt=LoopLen/LoopBatch/4;
+  int Run;
+  for(Run=0; Run<2; Run++)
+  { const char *Name = Run ? "save/restore":"full flush";
+    if(LoopDecode(0,Run,Run*SaveAt,Text,sizeof(Text)-1)<0) return -1;
+    int Same = strcmp(Text,Default)==0;
+    printf("%s => %s\n", Name, Same ? "same text":"DIFFERENT TEXT");
+    if(!Same) { printf("  %s\n",Text); Failed=1; } }
+
+  struct LoopOption *Opt;
+  for(Opt=LoopOptions; Opt->Option; Opt++)
+  { if(LoopDecode(Opt->Option,1,0,Text,sizeof(Text)-1)<0) return -1;
+    int Decoded = strstr(Text,LoopMessage)!=0;
+    int Same = strcmp(Text,Default)==0;
+    printf("%-6s => %s, %s\n", Opt->Option, Decoded ? "decoded":"NOT DECODED",
+           Same ? "same text":(Opt->Exact ? "DIFFERENT TEXT":"different text"));
+    if((!Decoded)||(Opt->Exact&&(!Same))) { printf("  %s\n",Text); Failed=1; }
+    if(!Opt->Save) continue;
+    static char Restored[1024];
+    if(LoopDecode(Opt->Option,1,SaveAt,Restored,sizeof(Restored)-1)<0) return -1;
+    Same = strcmp(Restored,Text)==0;
+    printf("%-6s save/restore => %s\n", Opt->Option, Same ? "same text":"DIFFERENT TEXT");
+    if(!Same) { printf("  %s\n",Restored); Failed=1; } }
+
+  if(LoopSkim()) Failed=1;
+
+  // the wide search must move the synchronizer window onto off-tuned signals,
+  // up to the edge of its margin (8 carriers = 250 Hz)
+  float Shift[3] = { +200, -200, +240 };
+  for(Run=0; Run<3; Run++)
+  { if(LoopGenerate(Shift[Run])<0) return -1;
+    if(LoopDecode("-W8",1,0,Text,sizeof(Text)-1)<0) return -1;
+    int Decoded = strstr(Text,LoopMessage)!=0;
+    printf("-W8 at %+3.0f Hz => %s\n", Shift[Run], Decoded ? "decoded":"NOT DECODED");
+    if(!Decoded) { printf("  %s\n",Text); Failed=1; } }
+
+  // the coarse pass must find a weak signal early enough for the soft search to decode it from the start
+  if(LoopGenerate(0,3.0)<0) return -1;
+  if(LoopDecode(0,1,0,Default,sizeof(Default)-1)<0) return -1;
+  if(LoopDecode("-H",1,0,Text,sizeof(Text)-1)<0) return -1;
+  int Decoded = strstr(Text,LoopMessage)!=0;
+  int Same = strcmp(Text,Default)==0;
+  printf("-H at noise 3.0 => %s, %s\n", Decoded ? "decoded":"NOT DECODED", Same ? "same text":"different text");
+  if(!Decoded) { printf("  %s\n  %s\n",Default,Text); Failed=1; }
+
+  if(TrackTest("-A0")) Failed=1;                  // the same without tracking, for comparison
+  if(TrackTest("-A4")) Failed=1;
+
+  free(LoopInput); LoopInput=0;
+  return Failed; }
+
+// ===================================================================
+
 int main(int argc, char *argv[])
 { int Error;
 
+  if((argc>1)&&(strcmp(argv[1],"multi")==0))
+  { srand(1); return MultiTest(); }
+
+  if((argc>1)&&(strcmp(argv[1],"loop")==0))
+  { srand(1); return LoopTest(); }
+
   time_t Now;
   time(&Now);
   srand(Now);
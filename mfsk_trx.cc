@@ -34,6 +34,7 @@ int LogAudio           = 0;       // log the received audio to a file
 MFSK_Parameters<float> Parameters; // parameters to the receiver
 
 SoundDevice Sound;               // sound card
+SoundMonitor Monitor;            // watches whether the receiver keeps up with the sound card
 
 size_t TxBufferLen=0;
 int16_t *TxBuffer;                     // transmitter audio buffer
@@ -83,8 +84,10 @@ static int ReadReceiverOutput(void)
 // read audio from the sound card and feed it into the Receiver
 static int FeedReceiver(void)
 { int Len=Sound.Read(RxBuffer,RxBufferLen); // read the audio from the sound card
+  Monitor.Read(Sound,Len,RxBufferLen);
   if(Len<0) return -1;
   Receiver.Process(RxBuffer,Len);           // process the audio through the receiver
+  Monitor.Processed(Len);
   return Len; }
 
 static void FlushReceiver(void)
@@ -109,7 +112,11 @@ static void PrintReceiverStatus(void)
 	       Receiver.SyncSNR(), Receiver.InputSNRdB(),
 		   Receiver.FrequencyOffset(), Parameters.TuneMargin(),
 		   60*Receiver.FrequencyDrift(), 1E6*Receiver.TimeDrift()  );
-  Terminal.RxStatLow(Status); }
+  Terminal.RxStatLow(Status);
+  static char MonitorStatus[128];
+  strcpy(MonitorStatus,"Audio: ");
+  Monitor.Status(MonitorStatus+7);        // and whether we keep up with the audio
+  Terminal.MonStat(MonitorStatus); }
 
 // switch to receive mode
 static int SwitchToReceive(void)
@@ -126,6 +133,7 @@ static int SwitchToReceive(void)
   { if(Sound.OpenForRead(DeviceName,SampleRate)<0) return -1; }
 
   Receiver.Reset();
+  Monitor.Restart();
   Terminal.RxStr("\nReceiving ...\n");
   Transmit=0;
 
@@ -221,6 +229,8 @@ mfsk_trx [options]\n\
   if(Error<0)
   { printf("Receiver.Preset() => %d\n",Error); return -1; }
 
+  Monitor.Reset(SampleRate);
+
   // see the audio block length required by the transmitter
   TxBufferLen=Transmitter.MaxOutputLen;
 
@@ -228,7 +238,7 @@ mfsk_trx [options]\n\
   AllocArray(&TxBuffer,TxBufferLen);
 
   sprintf(TextFileName,"mfsk_%s.log", TimeStr); // make the text log file name
-  Error=Terminal.Preset(10,LogText ? TextFileName:0); // open the terminal
+  Error=Terminal.Preset(10,LogText ? TextFileName:0,1); // open the terminal
   if(Error<0)
   { printf("Terminal.Preset() => %d\n",Error); return -1; }
 
@@ -269,6 +279,10 @@ mfsk_trx [options]\n\
 
   Terminal.Close(); // close the terminal
 
+  Monitor.Print();  // did the receiver keep up with the audio ?
+
+  if(Parameters.RxStats) Receiver.Stats.Print(); // where the receiver spent its time
+
   free(TxBuffer);   // deallocate the transmitter audio buffer
 
   Sound.Close();    // close the audio device
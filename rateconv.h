@@ -3,6 +3,7 @@
 #define __RATECONV_H__
 
 #include "struc.h"
+#include "buffer.h"
 
 
 // =====================================================================
@@ -35,9 +36,7 @@ template <class Type=float>
 
    size_t FilterLen;    // the total length of the filter (in term of oversampled rate)
    Type *FilterShape;   // the shape of the filter
-   Type *InputTap;      // filter tap
-   size_t InputTapPtr;
-   size_t InputWrap;
+   MirrorBuffer<Type> InputTap; // filter tap
 
    Type OutputTime;
    Type OutputPeriod;
@@ -55,12 +54,11 @@ template <class Type=float>
      { Free(); }
 
    void Init(void)
-     { FilterShape=0;
-	   InputTap=0; }
+     { FilterShape=0; }
 
    void Free(void)
      { free(FilterShape); FilterShape=0;
-	   free(InputTap); InputTap=0; }
+	   InputTap.Free(); }
 
    void Default(void)
      { TapLen=16;
@@ -75,7 +73,7 @@ template <class Type=float>
        FilterLen=TapLen*OverSampling;
 
        if((ReallocArray(&FilterShape,FilterLen))<0) goto Error;
-       if((ReallocArray(&InputTap,TapLen))<0) goto Error;
+       if((InputTap.Preset(TapLen))<0) goto Error;
 
        for(Idx=0; Idx<FilterLen; Idx++)
        { Type Phase=(M_PI*(2*(int)Idx-(int)FilterLen))/FilterLen;
@@ -95,12 +93,7 @@ template <class Type=float>
 	   Error: Free(); return -1; }
 
    void Reset(void)
-     { size_t Idx;
-
-       InputWrap=TapLen-1;
-       for(Idx=0; Idx<TapLen; Idx++)
-       { InputTap[Idx]=0; }
-       InputTapPtr=0;
+     { InputTap.Reset();
 
        OutputTime=0;
        OutputPeriod=OverSampling/OutputRate;
@@ -108,21 +101,29 @@ template <class Type=float>
 	   OutputAfter=0;
        OutputPtr=0;	}
 
+   // save (Load=0) or load (Load=1) the filter tap and the output phase,
+   // the converter must be preset the same, OutputPeriod stays as preset
+   int StateIO(FILE *File, int Load)
+     { if(InputTap.StateIO(File,Load)<0) return -1;
+       if(StateArray(File,Load,&OutputTime,1)<0) return -1;
+       if(StateArray(File,Load,&OutputBefore,1)<0) return -1;
+       if(StateArray(File,Load,&OutputAfter,1)<0) return -1;
+       return StateArray(File,Load,&OutputPtr,1); }
+
   private:
   
    Type Convolute(size_t Shift=0)
      { Type Sum=0;
        Shift=(OverSampling-1)-Shift;
-	   size_t Idx=InputTapPtr;
+	   Type *Tap=InputTap.Window();
 	   for( ; Shift<FilterLen; Shift+=OverSampling)
-       { Sum+=InputTap[Idx]*FilterShape[Shift];
-	     Idx+=1; Idx&=InputWrap; }
+       { Sum+=(*Tap)*FilterShape[Shift];
+	     Tap++; }
 	   return Sum; }
 
    void NewInput(Type Input)
      { // printf("I:\n");
-	   InputTap[InputTapPtr]=Input;
-	   InputTapPtr+=1; InputTapPtr&=InputWrap; }
+	   InputTap.Write(&Input,1); }
 
   public:
 
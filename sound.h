@@ -7,9 +7,9 @@
 
 // ============================================================================
 
-// #include <stdio.h>	// for debug only
-
+#include <stdio.h>
 #include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/soundcard.h>
 #include <sys/ioctl.h>
@@ -156,6 +156,15 @@ class SoundDevice
        else return 0x4000;
      } // returns the number of samples we can immediately read
 
+   // see how large the input buffer is
+   int ReadBufferLen(void)
+     { int Err; audio_buf_info info;
+       if(ReadFromDev)
+       { Err=ioctl(ReadDevNo,SNDCTL_DSP_GETISPACE,&info);
+         return Err ? -1 : (info.fragstotal*info.fragsize)>>1; }
+       else return 0;
+     } // returns the number of samples the device can hold, 0 for a file
+
    // write 16-bit samples into an (open) device / file
    int Write(int16_t *Buffer, int Samples)
      { Samples<<=1;
@@ -181,4 +190,108 @@ class SoundDevice
 
 // ============================================================================
 
+// watches whether the processing keeps up with the audio read from a sound device:
+// the time spent per audio second (the real-time factor), how the backlog of samples
+// waiting in the device grows, the short reads and the input buffer overruns
+
+class SoundMonitor
+{ public:
+
+   double AudioTime;      // [sec] audio read
+   double ProcessTime;    // [sec] time spent processing it
+   double RecentAudio;    // the above averaged over the last few seconds
+   double RecentProcess;
+   size_t Reads;          // number of reads
+   size_t ShortReads;     // reads from the device which failed or came short
+   size_t Overruns;       // reads which found the device buffer full: audio was lost
+   int Backlog;           // [samples] waiting in the device after the last read, -1 => unknown
+   int MaxBacklog;        // [samples] the largest backlog
+   double BacklogGrowth;  // [samples/sec] how fast the backlog grows (averaged)
+
+  private:
+
+   int Rate;              // [Hz] the sampling rate
+   int PrevBacklog;       // backlog after the previous read, -1 => none
+   double ReadEnd;        // [sec] when the last read completed
+
+  public:
+
+   SoundMonitor()
+     { Reset(); }
+
+   void Reset(int NewRate=8000)
+     { Rate=NewRate;
+       AudioTime=0; ProcessTime=0;
+       RecentAudio=0; RecentProcess=0;
+       Reads=0; ShortReads=0; Overruns=0;
+       Backlog=(-1); MaxBacklog=0; BacklogGrowth=0;
+       ReadEnd=0;
+       Restart(); }
+
+   // the device was (re)opened: keep the totals but start the backlog anew
+   void Restart(void)
+     { PrevBacklog=(-1); }
+
+   // call right after Sound.Read()
+   void Read(SoundDevice &Sound, int Len, int ReqLen)
+     { double Audio = Len>0 ? (double)Len/Rate:0;
+       ReadEnd=Time();
+       Reads+=1;
+       if(!Sound.ReadFromDev) return;             // a file: no backlog and no real time
+       if(Len<ReqLen) ShortReads+=1;
+       Backlog=Sound.ReadReady();
+       if(Backlog<0) return;
+       int BufferLen=Sound.ReadBufferLen();
+       if((BufferLen>0)&&(Backlog>=BufferLen)) Overruns+=1;
+       if(Backlog>MaxBacklog) MaxBacklog=Backlog;
+       if((PrevBacklog>=0)&&(Audio>0))
+       { double Weight=Audio/4.0; if(Weight>1) Weight=1;   // about 4 seconds
+         BacklogGrowth+=Weight*((Backlog-PrevBacklog)/Audio-BacklogGrowth); }
+       PrevBacklog=Backlog; }
+
+   // call after the audio of the last read was processed
+   void Processed(int Len)
+     { if(Len<=0) return;
+       double Audio=(double)Len/Rate;
+       double Process=Time()-ReadEnd;
+       double Weight=Audio/4.0; if(Weight>1) Weight=1;
+       AudioTime+=Audio; ProcessTime+=Process;
+       RecentAudio+=Weight*(Audio-RecentAudio);
+       RecentProcess+=Weight*(Process-RecentProcess); }
+
+   // processing time per audio second, below 1.0 to keep up with the audio
+   double Factor(void)
+     { return AudioTime>0 ? ProcessTime/AudioTime:0; }
+
+   double RecentFactor(void)
+     { return RecentAudio>0 ? RecentProcess/RecentAudio:0; }
+
+   // a short status line
+   void Status(char *Str)
+     { if(Backlog>=0)
+         sprintf(Str,"CPU x%4.2f, backlog %5d %+5.0f/s, %lu short, %lu lost",
+                 RecentFactor(), Backlog, BacklogGrowth,
+                 (unsigned long)ShortReads, (unsigned long)Overruns);
+       else
+         sprintf(Str,"CPU x%4.2f", RecentFactor()); }
+
+   // the end-of-run summary
+   void Print(FILE *File=stdout)
+     { fprintf(File,"Audio: %1.1f sec in %lu reads, processing %1.3f sec = x%5.3f real time\n",
+               AudioTime, (unsigned long)Reads, ProcessTime, Factor());
+       if(Backlog>=0)
+         fprintf(File,"Device: backlog %d samples (max. %d), %lu short reads, %lu overruns\n",
+                 Backlog, MaxBacklog, (unsigned long)ShortReads, (unsigned long)Overruns); }
+
+  private:
+
+   static double Time(void)
+     { struct timespec Time;
+       clock_gettime(CLOCK_MONOTONIC,&Time);
+       return Time.tv_sec+1E-9*Time.tv_nsec; }
+
+} ;
+
+// ============================================================================
+
 #endif // of __SOUND_H__
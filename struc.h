@@ -54,6 +54,12 @@ template <class type>
  inline void MoveArray(type *Dst, type *Src, size_t Size)
   { memmove(Dst,Src,Size*sizeof(type)); }
 
+// save (Load=0) or load (Load=1) an array to/from a binary file, -1 => incomplete
+template <class type>
+ inline int StateArray(FILE *File, int Load, type *Array, size_t Size)
+  { size_t Done = Load ? fread(Array,sizeof(type),Size,File) : fwrite(Array,sizeof(type),Size,File);
+    return Done==Size ? 0:-1; }
+
 template <class type>
  void PrintArray(type *Array, size_t Size,
                  char *ValueFormat, char *IndexFormat="%3d", size_t Columns=10)
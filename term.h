@@ -23,7 +23,7 @@ class SplitTerm
    int TxPos, TxLen;          // Tx window position and size [row]
    int TxCurX, TxCurY, TxAct; // Tx Window cursor position and active flag
 
-   int StatPos[4];            // positions of the four status lines [row]
+   int StatPos[5];            // positions of the four status lines and the monitor line [row]
 
    FILE *LogFile;             // log file (NULL is not open)
 
@@ -42,8 +42,9 @@ class SplitTerm
 	   { fclose(LogFile); LogFile=0; }
 	 }
 
-   // preset for given size of the transmitter (lower) window
-   int Preset(int TxLines=0, char *LogFileName=0)
+   // preset for given size of the transmitter (lower) window,
+   // MonLine=1 adds a monitor status line below the lower receiver status
+   int Preset(int TxLines=0, char *LogFileName=0, int MonLine=0)
      {
        if(Init) endwin();
 
@@ -60,15 +61,17 @@ class SplitTerm
 
        Width=COLS; Height=LINES;
        TxLen=TxLines;
-       if(TxLen==0) { RxLen=Height-TxLen-2; }
-	           else { RxLen=Height-TxLen-4; }
+       MonLine = MonLine ? 1:0;
+       if(TxLen==0) { RxLen=Height-TxLen-2-MonLine; }
+	           else { RxLen=Height-TxLen-4-MonLine; }
        RxPos=1;
-       TxPos=RxPos+RxLen+2;
+       TxPos=RxPos+RxLen+2+MonLine;
 
        StatPos[0]=0;
        StatPos[1]=RxPos+RxLen;
-       StatPos[2]=RxPos+RxLen+1;
+       StatPos[2]=RxPos+RxLen+1+MonLine;
        StatPos[3]=TxPos+TxLen;
+       StatPos[4] = MonLine ? RxPos+RxLen+1 : -1;
 
        RxCurX=0; RxCurY=RxPos; RxAct=0;
        TxCurX=0; TxCurY=TxPos; TxAct=0;
@@ -151,6 +154,7 @@ class SplitTerm
 
    void Status(int Stat, char *Str)
      { int i,y=StatPos[Stat];
+       if(y<0) return;
        RxAct=0; TxAct=0; move(y,0);
        attrset(A_REVERSE);
        for(i=0; (i<Width-1)&&Str[i]; i++) addch(Str[i]);
@@ -173,6 +177,9 @@ class SplitTerm
    void TxStatLow(char *Str) // lower transmitter status
      { Status(3,Str); }
 
+   void MonStat(char *Str)   // monitor status (if preset with MonLine)
+     { Status(4,Str); }
+
 } ;
 
 // ====================================================================
@@ -0,0 +1,269 @@
+// Persistent pool of worker threads for data-parallel DSP loops
+
+#ifndef __THREADS_H__
+#define __THREADS_H__
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+
+#include "struc.h"
+
+// ============================================================
+
+/*
+
+How to use the WorkerPool class:
+
+1. set Workers = number of threads to share the work (including the caller)
+   and call Preset(): this starts Workers-1 background threads
+   which then sleep until there is a job.
+
+2. call Run(Job,Context): Job(Context,Worker) is executed once
+   for every Worker=0..Workers-1 in parallel (the caller takes Worker=0)
+   and Run() returns only when all of them completed, thus Run()
+   is a barrier as well.
+
+3. the job usually splits a loop with Part(Worker,Len,Start,Stop)
+
+*/
+
+class WorkerPool
+{ public:
+
+   size_t Workers;            // number of workers (threads), including the calling one
+
+  private:
+
+   struct WorkerArg
+   { WorkerPool *Pool;
+     size_t Worker; } ;
+
+   pthread_t *Thread;         // the background threads
+   WorkerArg *Arg;            // and their arguments
+   size_t Started;            // number of background threads running
+
+   int Created;               // 1 => mutex and conditions are created
+   pthread_mutex_t Lock;
+   pthread_cond_t Start;      // signals a new job or the stop request
+   pthread_cond_t Done;       // signals that the background workers completed the job
+
+   size_t Generation;         // counts the jobs
+   size_t Pending;            // background workers still busy with the current job
+   int StopReq;               // request for the background threads to exit
+
+   void (*Job)(void *Context, size_t Worker);
+   void *Context;
+
+  public:
+
+   WorkerPool()
+     { Init();
+       Default(); }
+
+   ~WorkerPool()
+     { Free(); }
+
+   void Init(void)
+     { Thread=0; Arg=0;
+       Started=0; Created=0; }
+
+   void Default(void)
+     { Workers=1; }
+
+   void Free(void)
+     { if(Created)
+       { pthread_mutex_lock(&Lock);
+         StopReq=1;
+         pthread_cond_broadcast(&Start);
+         pthread_mutex_unlock(&Lock);
+         for( ; Started; Started--)
+           pthread_join(Thread[Started-1],0);
+         pthread_cond_destroy(&Done);
+         pthread_cond_destroy(&Start);
+         pthread_mutex_destroy(&Lock);
+         Created=0; }
+       free(Thread); Thread=0;
+       free(Arg); Arg=0; }
+
+   int Preset(void)
+     { Free();
+       if(Workers<1) Workers=1;
+       if(Workers==1) return 0;
+
+       if(ReallocArray(&Thread,Workers-1)<0) goto Error;
+       if(ReallocArray(&Arg,Workers-1)<0) goto Error;
+
+       pthread_mutex_init(&Lock,0);
+       pthread_cond_init(&Start,0);
+       pthread_cond_init(&Done,0);
+       Created=1;
+       Generation=0; Pending=0; StopReq=0;
+
+       for(Started=0; Started<(Workers-1); Started++)
+       { Arg[Started].Pool=this;
+         Arg[Started].Worker=Started+1;
+         if(pthread_create(Thread+Started,0,WorkerLoop,Arg+Started)) goto Error; }
+
+       return 0;
+
+       Error: Free(); Workers=1; return -1; }
+
+   // execute the job on all workers, return when all are done
+   void Run(void (*NewJob)(void *Context, size_t Worker), void *NewContext)
+     { if(Started==0) { (*NewJob)(NewContext,0); return; }
+       pthread_mutex_lock(&Lock);
+       Job=NewJob; Context=NewContext;
+       Pending=Started; Generation+=1;
+       pthread_cond_broadcast(&Start);
+       pthread_mutex_unlock(&Lock);
+       (*NewJob)(NewContext,0);
+       pthread_mutex_lock(&Lock);
+       while(Pending) pthread_cond_wait(&Done,&Lock);
+       pthread_mutex_unlock(&Lock); }
+
+   // the part [Start..Stop) of a loop of length Len which belongs to given worker
+   void Part(size_t Worker, size_t Len, size_t &Start, size_t &Stop)
+     { Start=(Len*Worker)/Workers;
+       Stop=(Len*(Worker+1))/Workers; }
+
+  private:
+
+   static void *WorkerLoop(void *Ptr)
+     { WorkerArg *Arg=(WorkerArg *)Ptr;
+       WorkerPool *Pool=Arg->Pool;
+       size_t Seen=0;
+       pthread_mutex_lock(&Pool->Lock);
+       for( ; ; )
+       { while((Pool->Generation==Seen)&&(!Pool->StopReq))
+           pthread_cond_wait(&Pool->Start,&Pool->Lock);
+         if(Pool->StopReq) break;
+         Seen=Pool->Generation;
+         pthread_mutex_unlock(&Pool->Lock);
+         (*Pool->Job)(Pool->Context,Arg->Worker);
+         pthread_mutex_lock(&Pool->Lock);
+         Pool->Pending-=1;
+         if(Pool->Pending==0) pthread_cond_signal(&Pool->Done); }
+       pthread_mutex_unlock(&Pool->Lock);
+       return 0; }
+
+} ;
+
+// ============================================================
+
+/*
+
+How to use the BlockQueue class:
+
+1. set Slots and SlotLen (in elements) and call Preset()
+
+2. the producer (one thread) fills WriteSlot() and hands it over with Commit(),
+   the consumer (another thread) takes ReadSlot() and gives it back with Release().
+   WriteSlot() waits when all slots are full, ReadSlot() when they are all empty.
+
+3. every slot carries its data length and a tag, which the user may use
+   for control messages (e.g. flush or stop) going along the data.
+
+The slots are handed over with two counting semaphores: these are futex-based,
+thus no lock is taken unless one side has to wait. A slot carries a whole
+input processor window or a symbol of spectral slices, so the hand-off cost
+is small against the work, and a stage with nothing to do sleeps in the kernel
+rather than spinning on an atomic counter: the synchronizer workers need
+the cores which the stages leave.
+
+*/
+
+template <class Type>
+ class BlockQueue
+{ public:
+
+   size_t Slots;              // number of slots
+   size_t SlotLen;            // [elements] slot capacity
+
+  private:
+
+   Type *Data;                // [Slots][SlotLen]
+   size_t *Len;               // [Slots] data length in the slot
+   int *Tag;                  // [Slots] tag of the slot
+   size_t WritePtr;           // owned by the producer
+   size_t ReadPtr;            // owned by the consumer
+
+   int Created;               // 1 => the semaphores are created
+   sem_t FreeSlots;           // counts the slots the producer may fill
+   sem_t FullSlots;           // counts the slots the consumer may take
+
+  public:
+
+   BlockQueue()
+     { Init();
+       Default(); }
+
+   ~BlockQueue()
+     { Free(); }
+
+   void Init(void)
+     { Data=0; Len=0; Tag=0;
+       Created=0; }
+
+   void Default(void)
+     { Slots=4; SlotLen=4096; }
+
+   void Free(void)
+     { if(Created)
+       { sem_destroy(&FullSlots);
+         sem_destroy(&FreeSlots);
+         Created=0; }
+       free(Data); Data=0;
+       free(Len); Len=0;
+       free(Tag); Tag=0; }
+
+   int Preset(void)
+     { Free();
+       if(Slots<2) Slots=2;
+       if(ReallocArray(&Data,Slots*SlotLen)<0) goto Error;
+       if(ReallocArray(&Len,Slots)<0) goto Error;
+       if(ReallocArray(&Tag,Slots)<0) goto Error;
+       if(sem_init(&FreeSlots,0,Slots)<0) goto Error;
+       if(sem_init(&FullSlots,0,0)<0) { sem_destroy(&FreeSlots); goto Error; }
+       Created=1;
+       WritePtr=0; ReadPtr=0;
+       return 0;
+
+       Error: Free(); return -1; }
+
+   int Preset(size_t NewSlots, size_t NewSlotLen)
+     { Slots=NewSlots; SlotLen=NewSlotLen; return Preset(); }
+
+   // the slot to be filled, wait if the queue is full
+   Type *WriteSlot(void)
+     { Wait(&FreeSlots);
+       return Data+WritePtr*SlotLen; }
+
+   // hand the filled slot over to the consumer
+   void Commit(size_t DataLen, int DataTag=0)
+     { Len[WritePtr]=DataLen; Tag[WritePtr]=DataTag;
+       WritePtr+=1; if(WritePtr>=Slots) WritePtr=0;
+       sem_post(&FullSlots); }
+
+   // the oldest slot with its length and tag, wait if the queue is empty
+   Type *ReadSlot(size_t &DataLen, int &DataTag)
+     { Wait(&FullSlots);
+       DataLen=Len[ReadPtr]; DataTag=Tag[ReadPtr];
+       return Data+ReadPtr*SlotLen; }
+
+   // give the slot back to the producer
+   void Release(void)
+     { ReadPtr+=1; if(ReadPtr>=Slots) ReadPtr=0;
+       sem_post(&FreeSlots); }
+
+  private:
+
+   static void Wait(sem_t *Sem)
+     { while(sem_wait(Sem)<0)
+         if(errno!=EINTR) break; }
+
+} ;
+
+// ============================================================
+
+#endif // of __THREADS_H__